@@ -0,0 +1,101 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/extractor/proto/file_cache.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <utility>
+
+namespace kythe {
+namespace lang_proto {
+namespace {
+
+int64_t ModificationTimeNs(const struct stat& st) {
+  return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+         st.st_mtim.tv_nsec;
+}
+
+}  // namespace
+
+bool FileCache::Read(const std::string& path, std::string* contents) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    ::close(fd);
+    return false;
+  }
+  std::shared_ptr<const std::string> cached;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto found = entries_.find(path);
+    if (found != entries_.end() && found->second.device == st.st_dev &&
+        found->second.inode == st.st_ino && found->second.size == st.st_size &&
+        found->second.mtime_ns == ModificationTimeNs(st)) {
+      cached = found->second.contents;
+    }
+  }
+  if (cached != nullptr) {
+    ::close(fd);
+    *contents = *cached;
+    return true;
+  }
+
+  // Read from the descriptor that was stat'ed, so the entry describes the
+  // contents it holds even if the file is replaced meanwhile.
+  std::string read_contents;
+  read_contents.reserve(st.st_size);
+  char buf[4096];
+  ssize_t amount_read;
+  while ((amount_read = ::read(fd, buf, sizeof buf)) > 0) {
+    read_contents.append(buf, amount_read);
+  }
+  ::close(fd);
+  if (amount_read < 0) {
+    return false;
+  }
+  // A file that changed while being read is not cached.
+  if (read_contents.size() != static_cast<size_t>(st.st_size) ||
+      read_contents.size() > max_bytes_) {
+    *contents = std::move(read_contents);
+    return true;
+  }
+  *contents = read_contents;
+  auto shared = std::make_shared<const std::string>(std::move(read_contents));
+
+  std::lock_guard<std::mutex> lock(mu_);
+  auto found = entries_.find(path);
+  if (found != entries_.end()) {
+    total_bytes_ -= found->second.contents->size();
+    entries_.erase(found);
+  }
+  if (total_bytes_ + shared->size() > max_bytes_) {
+    entries_.clear();
+    total_bytes_ = 0;
+  }
+  total_bytes_ += shared->size();
+  entries_.emplace(path, Entry{st.st_dev, st.st_ino, st.st_size,
+                               ModificationTimeNs(st), std::move(shared)});
+  return true;
+}
+
+}  // namespace lang_proto
+}  // namespace kythe
@@ -0,0 +1,74 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KYTHE_CXX_EXTRACTOR_PROTO_FILE_CACHE_H_
+#define KYTHE_CXX_EXTRACTOR_PROTO_FILE_CACHE_H_
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+
+namespace kythe {
+namespace lang_proto {
+
+/// \brief Keeps the contents of files read from disk, so that a long-lived
+/// extractor (such as a persistent worker) reads each unchanged file once.
+///
+/// A cached file is used only while its device, inode, size and modification
+/// time are those it was read with. This is safe to use from several threads
+/// at once.
+class FileCache {
+ public:
+  /// \param max_bytes The total size of the contents to keep. The cache is
+  /// emptied whenever it would grow past this.
+  explicit FileCache(size_t max_bytes = 256 << 20) : max_bytes_(max_bytes) {}
+
+  FileCache(const FileCache&) = delete;
+  FileCache& operator=(const FileCache&) = delete;
+
+  /// \brief Reads the whole file at `path` into `contents`, from the cache if
+  /// the file hasn't changed since it was cached. Returns false if the file
+  /// can't be read.
+  bool Read(const std::string& path, std::string* contents);
+
+ private:
+  struct Entry {
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    int64_t mtime_ns;
+    /// Shared, so that a hit is copied out without holding `mu_`.
+    std::shared_ptr<const std::string> contents;
+  };
+
+  const size_t max_bytes_;
+  std::mutex mu_;
+  /// Path -> the file last read from it.
+  absl::flat_hash_map<std::string, Entry> entries_;
+  /// The total size of the contents in `entries_`.
+  size_t total_bytes_ = 0;
+};
+
+}  // namespace lang_proto
+}  // namespace kythe
+
+#endif  // KYTHE_CXX_EXTRACTOR_PROTO_FILE_CACHE_H_
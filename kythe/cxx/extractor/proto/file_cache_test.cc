@@ -0,0 +1,92 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/extractor/proto/file_cache.h"
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace kythe {
+namespace lang_proto {
+namespace {
+
+class FileCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    const char* tmpdir = getenv("TEST_TMPDIR");
+    path_ = std::string(tmpdir != nullptr ? tmpdir : "/tmp") +
+            "/file_cache_test." + std::to_string(getpid()) + ".proto";
+  }
+
+  void TearDown() override { std::remove(path_.c_str()); }
+
+  // Replaces the file at `path_` with one holding `contents`.
+  void WriteFile(const std::string& contents) {
+    std::string tmp_path = path_ + ".tmp";
+    FILE* file = fopen(tmp_path.c_str(), "wb");
+    ASSERT_NE(file, nullptr);
+    ASSERT_EQ(fwrite(contents.data(), 1, contents.size(), file),
+              contents.size());
+    ASSERT_EQ(fclose(file), 0);
+    ASSERT_EQ(rename(tmp_path.c_str(), path_.c_str()), 0);
+  }
+
+  std::string path_;
+};
+
+TEST_F(FileCacheTest, ReadsFile) {
+  WriteFile("syntax = \"proto3\";");
+  FileCache cache;
+  std::string contents;
+  ASSERT_TRUE(cache.Read(path_, &contents));
+  EXPECT_EQ(contents, "syntax = \"proto3\";");
+  ASSERT_TRUE(cache.Read(path_, &contents));
+  EXPECT_EQ(contents, "syntax = \"proto3\";");
+}
+
+TEST_F(FileCacheTest, RereadsChangedFile) {
+  WriteFile("message A {}");
+  FileCache cache;
+  std::string contents;
+  ASSERT_TRUE(cache.Read(path_, &contents));
+  EXPECT_EQ(contents, "message A {}");
+  // Renaming a new file into place gives it a new inode.
+  WriteFile("message B {}");
+  ASSERT_TRUE(cache.Read(path_, &contents));
+  EXPECT_EQ(contents, "message B {}");
+}
+
+TEST_F(FileCacheTest, ReadsFilesLargerThanCache) {
+  WriteFile("message Large {}");
+  FileCache cache(/*max_bytes=*/4);
+  std::string contents;
+  ASSERT_TRUE(cache.Read(path_, &contents));
+  EXPECT_EQ(contents, "message Large {}");
+}
+
+TEST_F(FileCacheTest, FailsOnMissingFile) {
+  FileCache cache;
+  std::string contents;
+  EXPECT_FALSE(cache.Read(path_ + ".missing", &contents));
+}
+
+}  // namespace
+}  // namespace lang_proto
+}  // namespace kythe
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/extractor/proto/import_scanner.h"
+
+#include "absl/strings/str_cat.h"
+#include "google/protobuf/io/tokenizer.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "kythe/cxx/common/status.h"
+
+namespace kythe {
+namespace lang_proto {
+namespace {
+
+using ::google::protobuf::io::Tokenizer;
+
+// Error collector that keeps the first error reported by the tokenizer.
+class FirstErrorCollector : public google::protobuf::io::ErrorCollector {
+ public:
+  void AddError(int line, int column, const std::string& message) override {
+    if (error_.empty()) {
+      error_ = absl::StrCat(line + 1, ":", column + 1, ": ", message);
+    }
+  }
+
+  const std::string& error() const { return error_; }
+
+ private:
+  std::string error_;
+};
+
+bool IsSymbol(const Tokenizer::Token& token, absl::string_view symbol) {
+  return token.type == Tokenizer::TYPE_SYMBOL && token.text == symbol;
+}
+
+}  // namespace
+
+StatusOr<std::vector<std::string>> ScanImports(absl::string_view source) {
+  google::protobuf::io::ArrayInputStream input(source.data(), source.size());
+  FirstErrorCollector errors;
+  Tokenizer tokenizer(&input, &errors);
+
+  std::vector<std::string> imports;
+  int depth = 0;
+  bool statement_start = true;
+  tokenizer.Next();
+  while (tokenizer.current().type != Tokenizer::TYPE_END) {
+    const Tokenizer::Token& token = tokenizer.current();
+    if (depth == 0 && statement_start &&
+        token.type == Tokenizer::TYPE_IDENTIFIER && token.text == "import") {
+      tokenizer.Next();
+      if (tokenizer.current().type == Tokenizer::TYPE_IDENTIFIER &&
+          (tokenizer.current().text == "public" ||
+           tokenizer.current().text == "weak")) {
+        tokenizer.Next();
+      }
+      if (tokenizer.current().type != Tokenizer::TYPE_STRING) {
+        return InvalidArgumentError(
+            absl::StrCat(tokenizer.current().line + 1,
+                         ": expected a file name after \"import\""));
+      }
+      // Like the proto parser, concatenate adjacent string literals.
+      std::string name;
+      while (tokenizer.current().type == Tokenizer::TYPE_STRING) {
+        Tokenizer::ParseStringAppend(tokenizer.current().text, &name);
+        tokenizer.Next();
+      }
+      imports.push_back(std::move(name));
+      statement_start = false;
+      continue;
+    }
+    if (IsSymbol(token, "{")) {
+      ++depth;
+    } else if (IsSymbol(token, "}")) {
+      --depth;
+    }
+    statement_start =
+        depth == 0 && (IsSymbol(token, ";") || IsSymbol(token, "}"));
+    tokenizer.Next();
+  }
+  if (!errors.error().empty()) {
+    return InvalidArgumentError(errors.error());
+  }
+  return imports;
+}
+
+}  // namespace lang_proto
+}  // namespace kythe
@@ -0,0 +1,40 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KYTHE_CXX_EXTRACTOR_PROTO_IMPORT_SCANNER_H_
+#define KYTHE_CXX_EXTRACTOR_PROTO_IMPORT_SCANNER_H_
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "kythe/cxx/common/status_or.h"
+
+namespace kythe {
+namespace lang_proto {
+
+/// \brief Returns the names of the files imported by the proto source
+/// `source`, in the order they are imported.
+///
+/// Only the top-level `import`, `import public` and `import weak` statements
+/// are read; the rest of the file is tokenized but otherwise ignored, so
+/// a file that scans successfully may still fail to compile.
+StatusOr<std::vector<std::string>> ScanImports(absl::string_view source);
+
+}  // namespace lang_proto
+}  // namespace kythe
+
+#endif  // KYTHE_CXX_EXTRACTOR_PROTO_IMPORT_SCANNER_H_
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/extractor/proto/import_scanner.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace kythe {
+namespace lang_proto {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+TEST(ImportScannerTest, FindsAllKindsOfImports) {
+  auto imports = ScanImports(R"(
+    syntax = "proto3";
+    package foo;
+    import "a.proto";
+    import public "dir/b.proto";
+    import weak 'c.proto';
+    message Foo {}
+    import "d" ".proto";
+  )");
+  ASSERT_TRUE(imports.ok()) << imports.status();
+  EXPECT_THAT(*imports,
+              ElementsAre("a.proto", "dir/b.proto", "c.proto", "d.proto"));
+}
+
+TEST(ImportScannerTest, IgnoresImportsOutsideImportStatements) {
+  auto imports = ScanImports(R"(
+    // import "commented.proto";
+    /* import "block_commented.proto"; */
+    option java_package = "import";
+    message Foo {
+      optional string import = 1;
+      message Bar { import "nested.proto"; }
+    }
+  )");
+  ASSERT_TRUE(imports.ok()) << imports.status();
+  EXPECT_THAT(*imports, IsEmpty());
+}
+
+TEST(ImportScannerTest, RejectsImportsWithoutFileNames) {
+  EXPECT_FALSE(ScanImports("import foo;").ok());
+  EXPECT_FALSE(ScanImports("import public;").ok());
+}
+
+TEST(ImportScannerTest, RejectsUnterminatedStrings) {
+  EXPECT_FALSE(ScanImports("import \"a.proto;\n").ok());
+}
+
+}  // namespace
+}  // namespace lang_proto
+}  // namespace kythe
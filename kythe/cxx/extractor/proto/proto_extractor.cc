@@ -16,14 +16,25 @@
 
 #include "proto_extractor.h"
 
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <set>
 #include <string>
+#include <thread>
 
 #include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "absl/types/optional.h"
 #include "glog/logging.h"
 #include "google/protobuf/compiler/importer.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
 #include "kythe/cxx/common/file_vname_generator.h"
 #include "kythe/cxx/common/path_utils.h"
+#include "kythe/cxx/extractor/proto/import_scanner.h"
 #include "kythe/cxx/indexer/proto/search_path.h"
 #include "kythe/proto/analysis.pb.h"
 
@@ -31,46 +42,119 @@ namespace kythe {
 namespace lang_proto {
 namespace {
 
-// Error "collector" that just writes messages to log output.
+// Error "collector" that writes messages to log output, and keeps the errors
+// for reporting when an import fails.
 class LoggingMultiFileErrorCollector
     : public google::protobuf::compiler::MultiFileErrorCollector {
  public:
   void AddError(const std::string& filename, int line, int column,
                 const std::string& message) override {
     LOG(ERROR) << filename << "@" << line << ":" << column << ": " << message;
+    absl::StrAppend(&errors_, "\n", filename, "@", line, ":", column, ": ",
+                    message);
   }
 
   void AddWarning(const std::string& filename, int line, int column,
                   const std::string& message) override {
     LOG(ERROR) << filename << "@" << line << ":" << column << ": " << message;
   }
+
+  // Returns the errors added so far, each on a line of its own, and forgets
+  // them.
+  std::string TakeErrors() { return std::move(errors_); }
+
+ private:
+  std::string errors_;
 };
 
+// Reads the whole file at `path` into `contents`.
+bool ReadFile(const std::string& path, std::string* contents) {
+  FILE* handle = fopen(path.c_str(), "rb");
+  if (handle == nullptr) {
+    return false;
+  }
+  char buf[4096];
+  size_t amount_read;
+  while ((amount_read = fread(buf, 1, sizeof buf, handle)) > 0) {
+    contents->append(buf, amount_read);
+  }
+  bool ok = !ferror(handle);
+  fclose(handle);
+  return ok;
+}
+
 // DiskSourceTree that records which proto files are opened while parsing the
 // toplevel proto(s), allowing us to get a list of transitive dependencies.
+// Each file is resolved and read from disk once; its contents are kept for
+// writing to the kzip.
 class RecordingDiskSourceTree
     : public google::protobuf::compiler::DiskSourceTree {
  public:
+  // Files are read through `file_cache` if it is not null.
+  explicit RecordingDiskSourceTree(FileCache* file_cache)
+      : file_cache_(file_cache) {}
+
   google::protobuf::io::ZeroCopyInputStream* Open(
       const std::string& filename) override {
+    const std::string* contents = Read(filename);
+    if (contents == nullptr) {
+      return nullptr;
+    }
+    return new google::protobuf::io::ArrayInputStream(contents->data(),
+                                                      contents->size());
+  }
+
+  // Returns the contents of the file `filename` resolves to, reading and
+  // recording it if it has not been opened before, or null if there is no
+  // such file.
+  const std::string* Read(const std::string& filename) {
     // Record resolved/canonical path because the same proto may be Open()'d via
     // multiple relative paths and we only want to record it once.
-    std::string canonical_path;
-    if (!DiskSourceTree::VirtualFileToDiskFile(filename, &canonical_path)) {
+    const std::string* canonical_path = CanonicalPath(filename);
+    if (canonical_path == nullptr) {
       return nullptr;
     }
-    if (opened_files_.find(canonical_path) == opened_files_.end()) {
-      opened_files_.insert(canonical_path);
+    auto file = opened_files_.find(*canonical_path);
+    if (file == opened_files_.end()) {
+      std::string contents;
+      bool read = file_cache_ != nullptr
+                      ? file_cache_->Read(*canonical_path, &contents)
+                      : ReadFile(*canonical_path, &contents);
+      if (!read) {
+        LOG(ERROR) << "Couldn't read " << *canonical_path;
+        return nullptr;
+      }
+      file = opened_files_.emplace(*canonical_path, std::move(contents)).first;
     }
+    return &file->second;
+  }
 
-    return DiskSourceTree::Open(filename);
+  // Returns the path on disk that `filename` resolves to, or null if there is
+  // none. Results are cached.
+  const std::string* CanonicalPath(const std::string& filename) {
+    auto found = canonical_paths_.find(filename);
+    if (found == canonical_paths_.end()) {
+      std::string canonical_path;
+      if (!DiskSourceTree::VirtualFileToDiskFile(filename, &canonical_path)) {
+        return nullptr;
+      }
+      found = canonical_paths_.emplace(filename, std::move(canonical_path))
+                  .first;
+    }
+    return &found->second;
   }
 
-  // A set of unique file paths that have been passed to Open().
-  const std::set<std::string>& opened_files() const { return opened_files_; }
+  // Returns the unique files that have been passed to Open(), by canonical
+  // path, with their contents. The tree can't be used afterwards.
+  std::map<std::string, std::string> TakeOpenedFiles() {
+    return std::move(opened_files_);
+  }
 
  private:
-  std::set<std::string> opened_files_;
+  FileCache* file_cache_;
+  std::map<std::string, std::string> opened_files_;
+  // Name passed to Open() -> canonical path.
+  std::map<std::string, std::string> canonical_paths_;
 };
 
 // Loads all data from a file or terminates the process.
@@ -88,21 +172,133 @@ static std::string LoadFileOrDie(const std::string& file) {
   return content;
 }
 
+// Returns the name by which import statements refer to the top-level proto
+// `filename`: its path below the first search path that contains it, the way
+// protoc names its inputs, or `filename` itself if there is none. Returns
+// nullopt if that name resolves to some other file, which shadows this one.
+absl::optional<std::string> ImportName(const std::string& filename,
+                                       const SearchPathIndex& search_path,
+                                       RecordingDiskSourceTree* src_tree) {
+  std::string import_name =
+      search_path.RelativePath(CleanPath(filename)).value_or(filename);
+  if (import_name == filename) {
+    return import_name;
+  }
+  const std::string* disk_file = src_tree->CanonicalPath(filename);
+  const std::string* import_disk_file = src_tree->CanonicalPath(import_name);
+  if (disk_file == nullptr || import_disk_file == nullptr ||
+      CleanPath(*disk_file) != CleanPath(*import_disk_file)) {
+    return absl::nullopt;
+  }
+  return import_name;
+}
+
+// Opens `filenames` and everything they transitively import through
+// `src_tree`, reading only the import statements of each file. Fails if some
+// file can't be found or scanned.
+Status ScanImportClosure(const std::vector<std::string>& filenames,
+                         RecordingDiskSourceTree* src_tree) {
+  std::set<std::string> seen(filenames.begin(), filenames.end());
+  std::vector<std::string> pending(filenames.rbegin(), filenames.rend());
+  while (!pending.empty()) {
+    std::string filename = std::move(pending.back());
+    pending.pop_back();
+    const std::string* contents = src_tree->Read(filename);
+    if (contents == nullptr) {
+      return NotFoundError(absl::StrCat("Failed to import file: ", filename));
+    }
+    auto imports = ScanImports(*contents);
+    if (!imports.ok()) {
+      return InvalidArgumentError(absl::StrCat("Failed to scan imports of ",
+                                               filename, ": ",
+                                               imports.status().ToString()));
+    }
+    for (auto import = imports->rbegin(); import != imports->rend();
+         ++import) {
+      if (seen.insert(*import).second) {
+        pending.push_back(*import);
+      }
+    }
+  }
+  return OkStatus();
+}
+
+// Returns the required input, less its digest, for the file at `path`. Files
+// that `vname_gen` does not assign a corpus are given `corpus`.
+proto::CompilationUnit::FileInput MakeFileInput(
+    const FileVNameGenerator& vname_gen, const std::string& corpus,
+    const std::string& path) {
+  proto::CompilationUnit::FileInput file_input;
+  proto::VName vname = vname_gen.LookupVName(path);
+  if (vname.corpus().empty()) {
+    vname.set_corpus(corpus);
+  }
+  *file_input.mutable_v_name() = std::move(vname);
+  file_input.mutable_info()->set_path(path);
+  return file_input;
+}
+
+// Writes `unit` to `index_writer`, or returns the error in its place.
+Status WriteUnit(StatusOr<proto::CompilationUnit> unit,
+                 IndexWriter* index_writer) {
+  if (!unit.ok()) {
+    return unit.status();
+  }
+  proto::IndexedCompilation compilation;
+  *compilation.mutable_unit() = std::move(*unit);
+  auto digest = index_writer->WriteUnit(compilation);
+  if (!digest.ok()) {
+    return digest.status();
+  }
+  return OkStatus();
+}
+
 }  // namespace
 
-proto::CompilationUnit ProtoExtractor::ExtractProtos(
+StatusOr<proto::CompilationUnit> ProtoExtractor::ExtractProtos(
     const std::vector<std::string>& proto_filenames,
     IndexWriter* index_writer) const {
-  proto::CompilationUnit unit;
+  StatusOr<ProtoExtraction> extraction = Extract(proto_filenames);
+  if (!extraction.ok()) {
+    return extraction.status();
+  }
+  return WriteExtraction(std::move(*extraction), index_writer, nullptr);
+}
 
-  CHECK(GetCurrentDirectory(unit.mutable_working_directory()));
+StatusOr<ProtoExtraction> ProtoExtractor::Extract(
+    const std::vector<std::string>& proto_filenames) const {
+  ProtoExtraction extraction;
+  proto::CompilationUnit& unit = extraction.unit;
+
+  if (!GetCurrentDirectory(unit.mutable_working_directory())) {
+    return UnknownError("Couldn't get the current directory");
+  }
 
   for (const std::string& proto : proto_filenames) {
     unit.add_argument(proto);
   }
 
+  // Embed any precompiled descriptor sets, recording their paths as a protoc
+  // argument so the indexer can find them.
+  if (!descriptor_set_files.empty()) {
+    std::vector<std::string> set_paths;
+    for (const std::string& set_file : descriptor_set_files) {
+      std::string set_path = RelativizePath(set_file, root_directory);
+      std::string contents;
+      if (!ReadFile(set_file, &contents)) {
+        return NotFoundError(
+            absl::StrCat("Couldn't read descriptor set ", set_file));
+      }
+      *unit.add_required_input() = MakeFileInput(vname_gen, corpus, set_path);
+      extraction.files.emplace_back(set_file, std::move(contents));
+      set_paths.push_back(std::move(set_path));
+    }
+    unit.add_argument(
+        absl::StrCat("--descriptor_set_in=", absl::StrJoin(set_paths, ":")));
+  }
+
   // Add path substitutions to src_tree.
-  RecordingDiskSourceTree src_tree;
+  RecordingDiskSourceTree src_tree(file_cache);
   src_tree.MapPath("", "");  // Add current directory to VFS.
   for (const auto& sub : path_substitutions) {
     src_tree.MapPath(sub.first, sub.second);
@@ -117,60 +313,160 @@ proto::CompilationUnit ProtoExtractor::ExtractProtos(
   }
 
   // Import the toplevel proto(s), which will record paths of any transitive
-  // dependencies to src_tree.
+  // dependencies to src_tree. A single importer is shared so that each file
+  // is parsed once, however many top-level protos depend on it. Top-level
+  // protos are imported under the names other protos import them by, since
+  // importing the same file under two names would define its symbols twice.
   {
     LoggingMultiFileErrorCollector err_collector;
+    google::protobuf::compiler::Importer importer(&src_tree, &err_collector);
+    const SearchPathIndex search_path(path_substitutions);
+    std::vector<std::string> import_names;
     for (const std::string& fname : proto_filenames) {
-      // Note that a separate importer instance is used for each top-level
-      // import to avoid double-importing any subprotos, which would happen if
-      // two top-level protos share any transitive dependencies.
-      google::protobuf::compiler::Importer importer(&src_tree, &err_collector);
-      CHECK(importer.Import(fname) != nullptr)
-          << "Failed to import file: " << fname;
+      absl::optional<std::string> import_name =
+          ImportName(fname, search_path, &src_tree);
+      if (!validate) {
+        import_names.push_back(import_name.value_or(fname));
+      } else if (import_name.has_value()) {
+        if (importer.Import(*import_name) == nullptr) {
+          return InvalidArgumentError(absl::StrCat(
+              "Failed to import file: ", fname, err_collector.TakeErrors()));
+        }
+      } else {
+        // The file can't be imported by name, so nothing else depends on it;
+        // give it an importer of its own to keep it from clashing with the
+        // file that shadows it.
+        google::protobuf::compiler::Importer shadowed_importer(&src_tree,
+                                                               &err_collector);
+        if (shadowed_importer.Import(fname) == nullptr) {
+          return InvalidArgumentError(absl::StrCat(
+              "Failed to import file: ", fname, err_collector.TakeErrors()));
+        }
+      }
 
       unit.add_source_file(RelativizePath(fname, root_directory));
     }
-  }
-
-  // Write each toplevel proto and its transitive dependencies into the kzip.
-  for (const std::string& filename : src_tree.opened_files()) {
-    // Read file contents
-    std::string file_contents;
-    {
-      std::unique_ptr<google::protobuf::io::ZeroCopyInputStream> in_stream(
-          src_tree.Open(filename));
-      CHECK(in_stream != nullptr) << "Can't open file: " << filename;
-
-      const void* data = nullptr;
-      int size = 0;
-      while (in_stream->Next(&data, &size)) {
-        file_contents.append(static_cast<const char*>(data), size);
+    if (!validate) {
+      Status scanned = ScanImportClosure(import_names, &src_tree);
+      if (!scanned.ok()) {
+        return scanned;
       }
     }
+  }
 
-    // Resolve path relative to the proto compiler's search paths.
-    std::string full_path;
-    CHECK(src_tree.VirtualFileToDiskFile(filename, &full_path))
-        << "Error canonicalizing path: " << filename;
+  // Record each toplevel proto and its transitive dependencies, with the
+  // contents read while importing them.
+  for (auto& file : src_tree.TakeOpenedFiles()) {
     // Make path relative to KYTHE_ROOT_DIRECTORY.
-    full_path = RelativizePath(full_path, root_directory);
+    *unit.add_required_input() = MakeFileInput(
+        vname_gen, corpus, RelativizePath(file.first, root_directory));
+    extraction.files.emplace_back(file.first, std::move(file.second));
+  }
 
-    // Write file to index.
-    auto digest = index_writer->WriteFile(file_contents);
-    CHECK(digest.ok()) << digest.status();
+  return extraction;
+}
 
+StatusOr<proto::CompilationUnit> ProtoExtractor::WriteExtraction(
+    ProtoExtraction extraction, IndexWriter* index_writer,
+    absl::flat_hash_map<std::string, std::string>* written_files) {
+  proto::CompilationUnit unit = std::move(extraction.unit);
+  CHECK_EQ(static_cast<size_t>(unit.required_input_size()),
+           extraction.files.size());
+  for (size_t i = 0; i < extraction.files.size(); ++i) {
+    const auto& file = extraction.files[i];
+    const std::string* written = nullptr;
+    if (written_files != nullptr) {
+      auto found = written_files->find(file.first);
+      if (found != written_files->end()) {
+        written = &found->second;
+      }
+    }
+    std::string digest;
+    if (written != nullptr) {
+      digest = *written;
+    } else {
+      // Write file to index.
+      auto result = index_writer->WriteFile(file.second);
+      if (!result.ok()) {
+        return result.status();
+      }
+      digest = *std::move(result);
+      if (written_files != nullptr) {
+        written_files->emplace(file.first, digest);
+      }
+    }
     // Record file info to compilation unit.
-    proto::CompilationUnit::FileInput* file_input = unit.add_required_input();
-    proto::VName vname = vname_gen.LookupVName(full_path);
-    if (vname.corpus().empty()) {
-      vname.set_corpus(std::string(corpus));
+    unit.mutable_required_input(i)->mutable_info()->set_digest(
+        std::move(digest));
+  }
+  return unit;
+}
+
+Status ExtractProtoBatch(const std::vector<ProtoExtractionTarget>& targets,
+                         int threads, IndexWriter* index_writer) {
+  // Targets are extracted in parallel but written in order, so the kzip
+  // does not depend on scheduling. Extraction runs at most `max_in_flight`
+  // targets ahead of writing, which bounds the file contents held at once.
+  size_t worker_count = std::min<size_t>(std::max(threads, 1), targets.size());
+  const size_t max_in_flight = 2 * worker_count;
+  std::vector<absl::optional<StatusOr<ProtoExtraction>>> extractions(
+      targets.size());
+  std::mutex mu;
+  std::condition_variable changed;
+  size_t next_target = 0;  // Guarded by mu.
+  size_t written = 0;      // The number of targets written; guarded by mu.
+  bool failed = false;     // Whether to stop extracting; guarded by mu.
+  auto extract_targets = [&] {
+    for (;;) {
+      size_t i;
+      {
+        std::unique_lock<std::mutex> lock(mu);
+        changed.wait(lock, [&] {
+          return failed || next_target == targets.size() ||
+                 next_target < written + max_in_flight;
+        });
+        if (failed || next_target == targets.size()) return;
+        i = next_target++;
+      }
+      StatusOr<ProtoExtraction> extraction =
+          targets[i].extractor.Extract(targets[i].proto_filenames);
+      std::lock_guard<std::mutex> lock(mu);
+      extractions[i] = std::move(extraction);
+      changed.notify_all();
     }
-    *file_input->mutable_v_name() = std::move(vname);
-    file_input->mutable_info()->set_path(full_path);
-    file_input->mutable_info()->set_digest(*digest);
+  };
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < worker_count; ++i) {
+    workers.emplace_back(extract_targets);
   }
 
-  return unit;
+  // Disk path -> digest of each file written so far, so that files shared
+  // between targets are hashed and written once.
+  absl::flat_hash_map<std::string, std::string> written_files;
+  Status status = OkStatus();
+  for (size_t i = 0; i < targets.size() && status.ok(); ++i) {
+    absl::optional<StatusOr<ProtoExtraction>> extraction;
+    {
+      std::unique_lock<std::mutex> lock(mu);
+      changed.wait(lock, [&] { return extractions[i].has_value(); });
+      extraction.swap(extractions[i]);
+    }
+    status = extraction->status();
+    if (status.ok()) {
+      status = WriteUnit(ProtoExtractor::WriteExtraction(
+                             std::move(**extraction), index_writer,
+                             &written_files),
+                         index_writer);
+    }
+    std::lock_guard<std::mutex> lock(mu);
+    written = i + 1;
+    failed = !status.ok();
+    changed.notify_all();
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  return status;
 }
 
 void ProtoExtractor::ConfigureFromEnv() {
@@ -17,14 +17,32 @@
 #ifndef KYTHE_CXX_EXTRACTOR_PROTO_PROTO_EXTRACTOR_H_
 #define KYTHE_CXX_EXTRACTOR_PROTO_PROTO_EXTRACTOR_H_
 
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
 #include "absl/strings/string_view.h"
 #include "kythe/cxx/common/file_vname_generator.h"
 #include "kythe/cxx/common/index_writer.h"
+#include "kythe/cxx/common/status.h"
+#include "kythe/cxx/common/status_or.h"
+#include "kythe/cxx/extractor/proto/file_cache.h"
 #include "kythe/proto/analysis.pb.h"
 
 namespace kythe {
 namespace lang_proto {
 
+/// \brief A compilation unit extracted by ProtoExtractor::Extract(), along
+/// with the files it requires, which have not been written yet.
+struct ProtoExtraction {
+  /// The compilation unit, without digests for its required inputs.
+  proto::CompilationUnit unit;
+  /// The path on disk and the contents of each of the unit's required inputs,
+  /// in the same order.
+  std::vector<std::pair<std::string, std::string>> files;
+};
+
 class ProtoExtractor {
  public:
   /// Reads KYTHE_VNAMES, KYTHE_CORPUS, and KYTHE_ROOT_DIRECTORY environment
@@ -39,15 +57,42 @@ class ProtoExtractor {
   /// added to the compilation unit's "source_file" and "required_input" lists.
   /// \param index_writer A writer to save all required input files to.
   /// \return A compilation unit with all proto files and --proto_path arguments
-  /// recorded. Note that the returned compilation unit is not written to the
+  /// recorded, or an error if some file can't be read, imported or written.
+  /// Note that the returned compilation unit is not written to the
   /// index_writer.
-  proto::CompilationUnit ExtractProtos(
+  StatusOr<proto::CompilationUnit> ExtractProtos(
       const std::vector<std::string>& proto_filenames,
       IndexWriter* index_writer) const;
 
+  /// \brief Like ExtractProtos(), but leaves writing the files to the caller.
+  /// This is safe to call from several threads at once.
+  StatusOr<ProtoExtraction> Extract(
+      const std::vector<std::string>& proto_filenames) const;
+
+  /// \brief Writes the files of `extraction` to `index_writer` and returns its
+  /// compilation unit, with the digests of its required inputs filled in.
+  ///
+  /// \param written_files If not null, the digests of files already written
+  /// by their path on disk. Files found in it are not written again; others
+  /// are added to it.
+  static StatusOr<proto::CompilationUnit> WriteExtraction(
+      ProtoExtraction extraction, IndexWriter* index_writer,
+      absl::flat_hash_map<std::string, std::string>* written_files);
+
   /// Search paths where the proto compiler will look for proto files. See
   /// indexer/proto/search_path.h for details.
   std::vector<std::pair<std::string, std::string>> path_substitutions;
+  /// Serialized FileDescriptorSets (as written by protoc --descriptor_set_out)
+  /// to embed in the compilation unit. The indexer uses the descriptors in
+  /// them that include source info in place of parsing the proto files.
+  std::vector<std::string> descriptor_set_files;
+  /// Whether to compile the protos being extracted, failing on any errors.
+  /// Otherwise, their dependencies are found by scanning only their import
+  /// statements, which is much faster.
+  bool validate = true;
+  /// If not null, proto files are read through this cache, which may be
+  /// shared between extractors and outlive them. Not owned.
+  FileCache* file_cache = nullptr;
   /// Used to generate vnames for each proto file.
   FileVNameGenerator vname_gen;
   /// All paths recorded in the compilation unit will be made relative to this
@@ -58,6 +103,21 @@ class ProtoExtractor {
   std::string corpus;
 };
 
+/// One compilation unit of a batch: its toplevel protos and the extractor
+/// configured for them.
+struct ProtoExtractionTarget {
+  ProtoExtractor extractor;
+  std::vector<std::string> proto_filenames;
+};
+
+/// \brief Extracts each of `targets` on up to `threads` threads and writes
+/// their files and compilation units to `index_writer`, in order. Files shared
+/// between targets are hashed and written once. At most 2 * `threads` targets
+/// are extracted ahead of the one being written. Stops at the first target
+/// that fails, returning its error.
+Status ExtractProtoBatch(const std::vector<ProtoExtractionTarget>& targets,
+                         int threads, IndexWriter* index_writer);
+
 }  // namespace lang_proto
 }  // namespace kythe
 
@@ -22,26 +22,181 @@
 //   proto_extractor foo.proto
 //   proto_extractor foo.proto bar.proto
 //   proto_extractor foo.proto -- --proto_path dir/with/my/deps
+//   proto_extractor --batch_manifest=targets.txt
+//   proto_extractor --persistent_worker
 
 #include "kythe/cxx/extractor/proto/proto_extractor.h"
 
+#include <unistd.h>
+
+#include <fstream>
 #include <string>
 
+#include "absl/strings/ascii.h"
 #include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/strip.h"
 #include "gflags/gflags.h"
 #include "glog/logging.h"
 #include "kythe/cxx/common/kzip_writer.h"
+#include "kythe/cxx/common/status.h"
+#include "kythe/cxx/common/status_or.h"
+#include "kythe/cxx/extractor/proto/file_cache.h"
+#include "kythe/cxx/extractor/worker/persistent_worker.h"
 #include "kythe/cxx/indexer/proto/search_path.h"
 #include "kythe/proto/analysis.pb.h"
 
+DEFINE_string(descriptor_set_in, "",
+              "Colon-separated list of FileDescriptorSet files, as written by "
+              "protoc --descriptor_set_out --include_source_info, to embed in "
+              "the kzip. The indexer uses them in place of parsing the "
+              "proto files they describe, as long as their source info "
+              "still matches those files.");
+DEFINE_bool(validate, true,
+            "Compile the protos being extracted, failing on any errors. With "
+            "--novalidate, dependencies are found by reading only import "
+            "statements.");
+DEFINE_int32(threads, 1,
+             "Number of threads used to extract targets with "
+             "--batch_manifest.");
+DEFINE_string(batch_manifest, "",
+              "File listing many compilation units to extract into one kzip, "
+              "one per line. Each line holds the arguments that would be "
+              "given to a separate extractor run (proto files and search "
+              "paths), optionally with --corpus=<corpus> to override the "
+              "default corpus. Blank lines and lines starting with # are "
+              "ignored.");
+DEFINE_string(output_file, "",
+              "The kzip file to write, in place of the KYTHE_OUTPUT_FILE "
+              "environment variable. Each request to a persistent worker "
+              "names its own.");
+
 namespace kythe {
 namespace lang_proto {
 namespace {
-/// \brief Returns a kzip-based IndexWriter or dies.
-IndexWriter OpenKzipWriterOrDie(absl::string_view path) {
-  auto writer = KzipWriter::Create(path);
-  CHECK(writer.ok()) << "Failed to open KzipWriter: " << writer.status();
-  return std::move(*writer);
+/// \brief Splits `args` into path substitutions for `extractor` and the proto
+/// files to extract, which are returned.
+StatusOr<std::vector<std::string>> ParseProtoArgs(
+    const std::vector<std::string>& args, ProtoExtractor* extractor) {
+  // Parse --proto_path and -I args into a set of path substitutions (search
+  // paths). The remaining arguments should be .proto files.
+  std::vector<std::string> proto_filenames;
+  ::kythe::lang_proto::ParsePathSubstitutions(
+      args, &extractor->path_substitutions, &proto_filenames);
+  for (const std::string& arg : proto_filenames) {
+    if (!absl::EndsWith(arg, ".proto")) {
+      return InvalidArgumentError(
+          absl::StrCat("Invalid arg, expected a proto file: '", arg, "'"));
+    }
+  }
+  if (proto_filenames.empty()) {
+    return InvalidArgumentError("Expected 1+ .proto files.");
+  }
+  return proto_filenames;
+}
+
+/// \brief Reads the targets listed in the manifest at `path`, each extracted
+/// with a copy of `base_extractor`.
+StatusOr<std::vector<ProtoExtractionTarget>> ReadBatchManifest(
+    const std::string& path, const ProtoExtractor& base_extractor) {
+  std::ifstream manifest(path);
+  if (!manifest) {
+    return NotFoundError(absl::StrCat("Couldn't open batch manifest ", path));
+  }
+  std::vector<ProtoExtractionTarget> targets;
+  std::string line;
+  while (std::getline(manifest, line)) {
+    absl::string_view stripped = absl::StripAsciiWhitespace(line);
+    if (stripped.empty() || absl::StartsWith(stripped, "#")) {
+      continue;
+    }
+    ProtoExtractionTarget target{base_extractor, {}};
+    std::vector<std::string> args;
+    for (absl::string_view arg :
+         absl::StrSplit(stripped, absl::ByAnyChar(" \t"), absl::SkipEmpty())) {
+      if (absl::ConsumePrefix(&arg, "--corpus=")) {
+        target.extractor.corpus = std::string(arg);
+      } else {
+        args.emplace_back(arg);
+      }
+    }
+    auto proto_filenames = ParseProtoArgs(args, &target.extractor);
+    if (!proto_filenames.ok()) {
+      return proto_filenames.status();
+    }
+    target.proto_filenames = std::move(*proto_filenames);
+    targets.push_back(std::move(target));
+  }
+  if (targets.empty()) {
+    return InvalidArgumentError(
+        absl::StrCat("No targets in batch manifest ", path));
+  }
+  return targets;
+}
+
+/// \brief Extracts the compilation unit(s) that the positional `args` and the
+/// flags describe into a new kzip, starting from the configuration of
+/// `base_extractor`.
+Status ExtractToKzip(const std::vector<std::string>& args,
+                     const ProtoExtractor& base_extractor) {
+  ProtoExtractor extractor = base_extractor;
+  extractor.descriptor_set_files =
+      absl::StrSplit(FLAGS_descriptor_set_in, ':', absl::SkipEmpty());
+  extractor.validate = FLAGS_validate;
+
+  std::string output_file = FLAGS_output_file;
+  if (output_file.empty()) {
+    const char* env_output_file = getenv("KYTHE_OUTPUT_FILE");
+    if (env_output_file == nullptr) {
+      return InvalidArgumentError(
+          "Please specify an output kzip file with --output_file or the "
+          "KYTHE_OUTPUT_FILE environment variable.");
+    }
+    output_file = env_output_file;
+  }
+
+  if (!FLAGS_batch_manifest.empty()) {
+    if (!args.empty()) {
+      return InvalidArgumentError(
+          "No positional arguments are allowed with --batch_manifest.");
+    }
+    auto targets = ReadBatchManifest(FLAGS_batch_manifest, extractor);
+    if (!targets.ok()) {
+      return targets.status();
+    }
+    auto kzip_writer = KzipWriter::Create(output_file);
+    if (!kzip_writer.ok()) {
+      return kzip_writer.status();
+    }
+    Status status = ExtractProtoBatch(*targets, FLAGS_threads, &*kzip_writer);
+    if (!status.ok()) {
+      return status;
+    }
+    return kzip_writer->Close();
+  }
+
+  auto proto_filenames = ParseProtoArgs(args, &extractor);
+  if (!proto_filenames.ok()) {
+    return proto_filenames.status();
+  }
+  auto kzip_writer = KzipWriter::Create(output_file);
+  if (!kzip_writer.ok()) {
+    return kzip_writer.status();
+  }
+
+  // Extract and save kzip.
+  auto unit = extractor.ExtractProtos(*proto_filenames, &*kzip_writer);
+  if (!unit.ok()) {
+    return unit.status();
+  }
+  proto::IndexedCompilation compilation;
+  *compilation.mutable_unit() = std::move(*unit);
+  auto digest = kzip_writer->WriteUnit(compilation);
+  if (!digest.ok()) {
+    return digest.status();
+  }
+  return kzip_writer->Close();
 }
 }  // namespace
 
@@ -50,42 +205,51 @@ int main(int argc, char* argv[]) {
   gflags::SetUsageMessage(R"(Standalone extractor for the Kythe Proto indexer.
 Creates a Kzip containing the main proto file(s) and any dependencies.
 
+With --persistent_worker, serves Bazel persistent worker requests on stdin and
+stdout, each holding the arguments of one extraction (including --output_file).
+The vname configuration is loaded once, and unchanged files are read once.
+
 Examples:
   export KYTHE_OUTPUT_FILE=foo.kzip
   proto_extractor foo.proto
   proto_extractor foo.proto bar.proto
-  proto_extractor foo.proto -- --proto_path dir/with/my/deps")");
+  proto_extractor foo.proto -- --proto_path dir/with/my/deps
+  proto_extractor --descriptor_set_in=foo.pb foo.proto
+  proto_extractor --novalidate foo.proto
+  proto_extractor --batch_manifest=targets.txt --threads=8
+  proto_extractor --persistent_worker")");
+  bool persistent_worker = IsPersistentWorker(argc, argv);
   gflags::ParseCommandLineFlags(&argc, &argv, /*remove_flags=*/true);
   std::vector<std::string> final_args(argv + 1, argv + argc);
 
   ProtoExtractor extractor;
   extractor.ConfigureFromEnv();
 
-  const char* env_output_file = getenv("KYTHE_OUTPUT_FILE");
-  CHECK(env_output_file != nullptr)
-      << "Please specify an output kzip file with the KYTHE_OUTPUT_FILE "
-         "environment variable.";
-  IndexWriter kzip_writer = OpenKzipWriterOrDie(env_output_file);
-
-  // Parse --proto_path and -I args into a set of path substitutions (search
-  // paths). The remaining arguments should be .proto files.
-  std::vector<std::string> proto_filenames;
-  ::kythe::lang_proto::ParsePathSubstitutions(
-      final_args, &extractor.path_substitutions, &proto_filenames);
-  for (const std::string& arg : proto_filenames) {
-    CHECK(absl::EndsWith(arg, ".proto"))
-        << "Invalid arg, expected a proto file: '" << arg << "'";
+  if (persistent_worker) {
+    CHECK(final_args.empty())
+        << "No positional arguments are allowed with --persistent_worker.";
+    FileCache file_cache;
+    extractor.file_cache = &file_cache;
+    // Failed requests are reported in their responses, leaving the worker
+    // and its caches to serve the next.
+    bool served = RunPersistentWorker(
+        STDIN_FILENO, STDOUT_FILENO,
+        [&](const std::vector<std::string>& args, std::string* output) {
+          Status status = ExtractToKzip(args, extractor);
+          if (!status.ok()) {
+            *output = status.ToString();
+            return 1;
+          }
+          return 0;
+        });
+    return served ? 0 : 1;
   }
-  CHECK(!proto_filenames.empty()) << "Expected 1+ .proto files.";
-
-  // Extract and save kzip.
-  proto::IndexedCompilation compilation;
-  *compilation.mutable_unit() =
-      extractor.ExtractProtos(proto_filenames, &kzip_writer);
-  auto digest = kzip_writer.WriteUnit(compilation);
-  CHECK(digest.ok()) << "Error writing unit to kzip: " << digest.status();
-  CHECK(kzip_writer.Close().ok());
 
+  Status status = ExtractToKzip(final_args, extractor);
+  if (!status.ok()) {
+    LOG(ERROR) << status.ToString();
+    return 1;
+  }
   return 0;
 }
 
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Checks that the compilation units in one kzip are exactly those in a set of
+// others, such as a batch extraction against extractions of each target on
+// its own, and that every file they require was written. Working directories
+// are not compared.
+//
+// Usage: kzip_match KZIP EXPECTED_KZIP...
+
+#include <iostream>
+#include <map>
+#include <string>
+
+#include "absl/strings/string_view.h"
+#include "glog/logging.h"
+#include "google/protobuf/text_format.h"
+#include "kythe/cxx/common/kzip_reader.h"
+#include "kythe/proto/analysis.pb.h"
+
+namespace kythe {
+namespace {
+
+// Compilation units in text format -> the number of times each occurs.
+using UnitCounts = std::map<std::string, int>;
+
+// Adds the units in the kzip at `path` to `units`. Returns false, after
+// describing the problem, if the kzip can't be read or is missing a file
+// one of its units requires.
+bool ReadUnits(const std::string& path, UnitCounts* units) {
+  StatusOr<IndexReader> reader = KzipReader::Open(path);
+  if (!reader) {
+    std::cerr << "Couldn't open kzip " << path << ": " << reader.status()
+              << std::endl;
+    return false;
+  }
+  bool complete = true;
+  auto status = reader->Scan([&](absl::string_view digest) {
+    auto compilation = reader->ReadUnit(digest);
+    if (!compilation) {
+      std::cerr << "Couldn't read unit " << digest << " from " << path << ": "
+                << compilation.status() << std::endl;
+      complete = false;
+      return true;
+    }
+    for (const auto& file : compilation->unit().required_input()) {
+      if (!reader->ReadFile(file.info().digest())) {
+        std::cerr << path << " is missing " << file.info().path() << " ("
+                  << file.info().digest() << ")" << std::endl;
+        complete = false;
+      }
+    }
+    // The working directory depends on where the extraction ran, as each
+    // sandboxed action runs in a directory of its own.
+    compilation->mutable_unit()->clear_working_directory();
+    std::string text;
+    google::protobuf::TextFormat::PrintToString(compilation->unit(), &text);
+    ++(*units)[text];
+    return true;
+  });
+  if (!status.ok()) {
+    std::cerr << "Couldn't scan " << path << ": " << status << std::endl;
+    return false;
+  }
+  return complete;
+}
+
+// Describes each unit that occurs more often in `units` than in `other`.
+// Returns whether there were any.
+bool ReportExtraUnits(const UnitCounts& units, const UnitCounts& other,
+                      absl::string_view description) {
+  bool found = false;
+  for (const auto& unit : units) {
+    auto found_other = other.find(unit.first);
+    int other_count = found_other == other.end() ? 0 : found_other->second;
+    if (unit.second > other_count) {
+      std::cerr << description << ":\n" << unit.first << std::endl;
+      found = true;
+    }
+  }
+  return found;
+}
+
+}  // namespace
+}  // namespace kythe
+
+int main(int argc, char* argv[]) {
+  google::InitGoogleLogging(argv[0]);
+  if (argc < 3) {
+    std::cerr << "Usage: " << argv[0] << " KZIP EXPECTED_KZIP..." << std::endl;
+    return 2;
+  }
+  kythe::UnitCounts units;
+  kythe::UnitCounts expected_units;
+  bool ok = kythe::ReadUnits(argv[1], &units);
+  for (int i = 2; i < argc; ++i) {
+    ok = kythe::ReadUnits(argv[i], &expected_units) && ok;
+  }
+  // Both directions are checked, so that nothing is missed or repeated.
+  ok = !kythe::ReportExtraUnits(units, expected_units, "Unexpected unit") && ok;
+  ok = !kythe::ReportExtraUnits(expected_units, units, "Missing unit") && ok;
+  if (!ok) {
+    return 1;
+  }
+  std::cout << "All " << argc - 2 << " kzips matched." << std::endl;
+  return 0;
+}
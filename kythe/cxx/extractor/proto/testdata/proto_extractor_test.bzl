@@ -17,7 +17,8 @@
 load("@bazel_skylib//lib:dicts.bzl", "dicts")
 
 def _extract_kzip_impl(ctx):
-    cmd = [ctx.executable.extractor.path] + [p.path for p in ctx.files.srcs] + ctx.attr.opts
+    opts = [ctx.expand_location(opt, ctx.attr.deps) for opt in ctx.attr.opts]
+    cmd = [ctx.executable.extractor.path] + [p.path for p in ctx.files.srcs] + opts
     ctx.actions.run_shell(
         mnemonic = "Extract",
         command = " ".join(cmd),
@@ -31,7 +32,7 @@ def _extract_kzip_impl(ctx):
 extract_kzip = rule(
     implementation = _extract_kzip_impl,
     attrs = {
-        "srcs": attr.label_list(allow_files = True, mandatory = True),
+        "srcs": attr.label_list(allow_files = True),
         "deps": attr.label_list(allow_files = True),
         "extractor": attr.label(
             cfg = "host",
@@ -84,13 +85,89 @@ kzip_diff_test = rule(
     test = True,
 )
 
+def _kzip_match_test_impl(ctx):
+    # Write a script that `bazel test` will execute.
+    script = " ".join([
+        ctx.executable.match_bin.short_path,
+        ctx.file.kzip.short_path,
+    ] + [f.short_path for f in ctx.files.expected])
+    ctx.actions.write(
+        output = ctx.outputs.executable,
+        content = script,
+    )
+
+    runfiles = ctx.runfiles(files = [
+        ctx.executable.match_bin,
+        ctx.file.kzip,
+    ] + ctx.files.expected)
+    return [DefaultInfo(runfiles = runfiles)]
+
+kzip_match_test = rule(
+    implementation = _kzip_match_test_impl,
+    attrs = {
+        "kzip": attr.label(allow_files = True, mandatory = True, single_file = True),
+        "expected": attr.label_list(allow_files = True, mandatory = True),
+        "match_bin": attr.label(
+            cfg = "host",
+            executable = True,
+            default = Label("//kythe/cxx/extractor/proto/testdata:kzip_match"),
+        ),
+    },
+    test = True,
+)
+
+def _worker_extract_kzips_impl(ctx):
+    # One request per line, each writing the kzip of the same index.
+    requests = ctx.actions.declare_file(ctx.label.name + ".requests")
+    ctx.actions.write(
+        output = requests,
+        content = "".join([
+            "--output_file=%s %s\n" % (kzip.path, ctx.expand_location(request, ctx.attr.deps))
+            for kzip, request in zip(ctx.outputs.kzips, ctx.attr.requests)
+        ]),
+    )
+    cmd = [
+        ctx.executable.driver.path,
+        "--requests=" + requests.path,
+        "--",
+        ctx.executable.extractor.path,
+    ]
+    ctx.actions.run_shell(
+        mnemonic = "WorkerExtract",
+        command = " ".join(cmd),
+        outputs = ctx.outputs.kzips,
+        tools = [ctx.executable.driver, ctx.executable.extractor],
+        inputs = [requests] + ctx.files.deps,
+    )
+    return [DefaultInfo(runfiles = ctx.runfiles(files = ctx.outputs.kzips))]
+
+worker_extract_kzips = rule(
+    implementation = _worker_extract_kzips_impl,
+    attrs = {
+        "requests": attr.string_list(mandatory = True),
+        "kzips": attr.output_list(mandatory = True),
+        "deps": attr.label_list(allow_files = True),
+        "driver": attr.label(
+            cfg = "host",
+            executable = True,
+            default = Label("//kythe/cxx/extractor/worker:worker_driver"),
+        ),
+        "extractor": attr.label(
+            cfg = "host",
+            executable = True,
+            default = Label("//kythe/cxx/extractor/proto:proto_extractor"),
+        ),
+    },
+)
+
 def extractor_golden_test(
         name,
         srcs,
         deps = [],
         opts = [],
         extra_env = {},
-        extractor = "//kythe/cxx/extractor/proto:proto_extractor"):
+        extractor = "//kythe/cxx/extractor/proto:proto_extractor",
+        golden_file = None):
     """Runs the extractor and compares the result to a golden file.
 
     Args:
@@ -100,6 +177,7 @@ def extractor_golden_test(
       opts: arguments to pass to the extractor
       extra_env: environment variables to configure extractor behavior
       extractor: the extractor binary to use
+      golden_file: the expected unit, if not name + ".UNIT"
     """
     kzip = name + "_kzip"
     extract_kzip(
@@ -115,5 +193,79 @@ def extractor_golden_test(
     kzip_diff_test(
         name = name + "_test",
         kzip = kzip,
-        golden_file = name + ".UNIT",
+        golden_file = golden_file or name + ".UNIT",
+    )
+
+def extractor_batch_test(
+        name,
+        manifest,
+        expected,
+        deps = [],
+        opts = [],
+        extractor = "//kythe/cxx/extractor/proto:proto_extractor"):
+    """Runs the extractor on a batch manifest and compares the result to the
+    kzips of extracting each target on its own.
+
+    Args:
+      name: test name (note: _test will be appended to the end)
+      manifest: the --batch_manifest file
+      expected: the kzips that together hold the expected units, such as the
+        _kzip targets of extractor_golden_test rules
+      deps: the files the manifest refers to
+      opts: further arguments to pass to the extractor
+      extractor: the extractor binary to use
+    """
+    kzip = name + "_kzip"
+    extract_kzip(
+        name = kzip,
+        opts = ["--batch_manifest=$(location %s)" % manifest] + opts,
+        deps = deps + [manifest],
+        extractor = extractor,
+        testonly = True,
+    )
+
+    kzip_match_test(
+        name = name + "_test",
+        kzip = kzip,
+        expected = expected,
+    )
+
+def extractor_worker_test(
+        name,
+        requests,
+        deps = [],
+        extractor = "//kythe/cxx/extractor/proto:proto_extractor"):
+    """Sends the extractor a series of requests as a persistent worker and
+    compares the kzip each one writes to that of a one-shot extraction.
+
+    Args:
+      name: test name (note: _test will be appended to the end)
+      requests: a list of (arguments, expected kzip) pairs, one per request,
+        where the arguments omit --output_file and the expected kzip is such
+        as the _kzip target of an extractor_golden_test rule
+      deps: the files the requests refer to
+      extractor: the extractor binary to use
+    """
+    kzips = ["%s_%d.kzip" % (name, i) for i in range(len(requests))]
+    worker_extract_kzips(
+        name = name + "_kzips",
+        requests = [args for args, _ in requests],
+        kzips = kzips,
+        deps = deps,
+        extractor = extractor,
+        testonly = True,
+    )
+
+    tests = []
+    for kzip, request in zip(kzips, requests):
+        test = kzip[:-len(".kzip")] + "_test"
+        kzip_match_test(
+            name = test,
+            kzip = kzip,
+            expected = [request[1]],
+        )
+        tests.append(test)
+    native.test_suite(
+        name = name + "_test",
+        tests = tests,
     )
@@ -14,7 +14,12 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
-load("//kythe/cxx/extractor/proto/testdata:proto_extractor_test.bzl", "extractor_golden_test")
+load(
+    "//kythe/cxx/extractor/proto/testdata:proto_extractor_test.bzl",
+    "extractor_batch_test",
+    "extractor_golden_test",
+    "extractor_worker_test",
+)
 
 def textproto_extractor_golden_test(**kwargs):
     """Alias for extractor_golden_test, with the textproto extractor swapped in.
@@ -23,3 +28,19 @@ def textproto_extractor_golden_test(**kwargs):
         extractor = "//kythe/cxx/extractor/textproto:textproto_extractor",
         **kwargs
     )
+
+def textproto_extractor_batch_test(**kwargs):
+    """Alias for extractor_batch_test, with the textproto extractor swapped in.
+    """
+    extractor_batch_test(
+        extractor = "//kythe/cxx/extractor/textproto:textproto_extractor",
+        **kwargs
+    )
+
+def textproto_extractor_worker_test(**kwargs):
+    """Alias for extractor_worker_test, with the textproto extractor swapped in.
+    """
+    extractor_worker_test(
+        extractor = "//kythe/cxx/extractor/textproto:textproto_extractor",
+        **kwargs
+    )
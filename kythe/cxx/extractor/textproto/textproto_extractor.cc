@@ -22,18 +22,31 @@
 //   export KYTHE_OUTPUT_FILE=foo.kzip
 //   textproto_extractor foo.pbtxt
 //   textproto_extractor foo.pbtxt -- --proto_path dir/with/proto/deps
+//   textproto_extractor --batch_manifest=textprotos.txt -- --proto_path dir
+//   textproto_extractor --persistent_worker
 
 #include "kythe/cxx/extractor/proto/proto_extractor.h"
 
+#include <unistd.h>
+
+#include <fstream>
+#include <iterator>
 #include <string>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/ascii.h"
 #include "absl/strings/match.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
 #include "absl/strings/str_split.h"
 #include "gflags/gflags.h"
 #include "glog/logging.h"
 #include "kythe/cxx/common/kzip_writer.h"
+#include "kythe/cxx/common/status.h"
+#include "kythe/cxx/common/status_or.h"
+#include "kythe/cxx/extractor/proto/file_cache.h"
 #include "kythe/cxx/extractor/textproto/textproto_schema.h"
+#include "kythe/cxx/extractor/worker/persistent_worker.h"
 #include "kythe/cxx/indexer/proto/search_path.h"
 #include "kythe/proto/analysis.pb.h"
 
@@ -42,31 +55,298 @@ DEFINE_string(proto_message, "",
 DEFINE_string(proto_files, "",
               "A comma-separated list of proto files needed to fully define "
               "the textproto's schema.");
+DEFINE_string(batch_manifest, "",
+              "File listing many textprotos to extract into one kzip, one "
+              "per line, each into a compilation unit of its own. Blank "
+              "lines and lines starting with # are ignored. The protos of "
+              "each distinct schema are extracted once.");
+DEFINE_string(output_file, "",
+              "The kzip file to write, in place of the KYTHE_OUTPUT_FILE "
+              "environment variable. Each request to a persistent worker "
+              "names its own.");
 
 namespace kythe {
 namespace lang_textproto {
 namespace {
 
-/// \brief Returns a kzip-based IndexWriter or dies.
-IndexWriter OpenKzipWriterOrDie(absl::string_view path) {
-  auto writer = KzipWriter::Create(path);
-  CHECK(writer.ok()) << "Failed to open KzipWriter: " << writer.status();
-  return std::move(*writer);
+/// \brief Returns the contents of the file at `path`, read through
+/// `file_cache` if it is not null.
+StatusOr<std::string> ReadTextproto(const std::string& path,
+                                    lang_proto::FileCache* file_cache) {
+  std::string textproto;
+  if (file_cache != nullptr) {
+    if (!file_cache->Read(path, &textproto)) {
+      return NotFoundError(absl::StrCat("Couldn't read input file ", path));
+    }
+    return textproto;
+  }
+  std::ifstream input(path, std::ios::binary);
+  if (!input) {
+    return NotFoundError(absl::StrCat("Couldn't open input file ", path));
+  }
+  textproto.assign(std::istreambuf_iterator<char>(input),
+                   std::istreambuf_iterator<char>());
+  if (input.bad()) {
+    return UnknownError(absl::StrCat("Couldn't read input file ", path));
+  }
+  return textproto;
+}
+
+/// \brief Returns the schema of the textproto `textproto_filename`, whose
+/// contents are `textproto`, with its proto files listed in `proto_file` and
+/// `proto_imports`, or an error if it is incomplete.
+StatusOr<TextprotoSchema> ResolveSchema(const std::string& textproto_filename,
+                                        const std::string& textproto) {
+  // Info about the textproto's corresponding proto can come from comments in
+  // the textproto itself or as command line flags to the extractor. Note that
+  // if metadata is specified both in the textproto and via flags, flags take
+  // precedence.
+  TextprotoSchema schema = ParseTextprotoSchemaComments(textproto);
+  if (!FLAGS_proto_files.empty()) {
+    std::vector<std::string> proto_files =
+        absl::StrSplit(FLAGS_proto_files, ',');
+    schema.proto_file = proto_files.front();
+    schema.proto_imports.assign(proto_files.begin() + 1, proto_files.end());
+  }
+  if (!FLAGS_proto_message.empty()) {
+    schema.proto_message = FLAGS_proto_message;
+  }
+  if (schema.proto_file.empty()) {
+    return InvalidArgumentError(absl::StrCat(
+        "Proto file must be specified either with --proto_files flag or in "
+        "textproto comments of ",
+        textproto_filename));
+  }
+  if (schema.proto_message.empty()) {
+    return InvalidArgumentError(absl::StrCat(
+        "Proto message must be specified either with --proto_message flag or "
+        "in textproto comments of ",
+        textproto_filename));
+  }
+  return schema;
+}
+
+/// \brief Returns the proto files that define `schema`.
+std::vector<std::string> SchemaProtoFiles(const TextprotoSchema& schema) {
+  std::vector<std::string> proto_filenames = {schema.proto_file};
+  proto_filenames.insert(proto_filenames.end(), schema.proto_imports.begin(),
+                         schema.proto_imports.end());
+  return proto_filenames;
+}
+
+/// \brief Turns `unit`, the compilation unit of the protos that define the
+/// schema of a textproto, into the unit of the textproto itself.
+/// \param digest The digest of the textproto, which has been written.
+void AddTextprotoToUnit(const std::string& textproto_filename,
+                        const std::string& digest,
+                        const std::string& proto_message,
+                        const lang_proto::ProtoExtractor& proto_extractor,
+                        proto::CompilationUnit* unit) {
+  // Replace the proto extractor's source file list with our textproto.
+  unit->clear_source_file();
+  unit->add_source_file(textproto_filename);
+
+  // Re-build compilation unit's arguments list. Add --proto_message and any
+  // protoc args.
+  unit->clear_argument();
+  unit->add_argument(textproto_filename);
+  unit->add_argument("--proto_message");
+  unit->add_argument(proto_message);
+  // Add protoc args.
+  if (!proto_extractor.path_substitutions.empty()) {
+    unit->add_argument("--");
+    for (auto& arg : lang_proto::PathSubstitutionsToArgs(
+             proto_extractor.path_substitutions)) {
+      unit->add_argument(arg);
+    }
+  }
+
+  // Add textproto file to the unit.
+  proto::CompilationUnit::FileInput* file_input = unit->add_required_input();
+  proto::VName vname =
+      proto_extractor.vname_gen.LookupVName(textproto_filename);
+  if (vname.corpus().empty()) {
+    vname.set_corpus(proto_extractor.corpus);
+  }
+  *file_input->mutable_v_name() = std::move(vname);
+  file_input->mutable_info()->set_path(textproto_filename);
+  file_input->mutable_info()->set_digest(digest);
+}
+
+/// \brief Writes the textproto `textproto_filename`, whose contents are
+/// `textproto`, and a compilation unit for it based on `schema_unit` to
+/// `kzip_writer`.
+Status WriteTextprotoUnit(const std::string& textproto_filename,
+                          const std::string& textproto,
+                          const std::string& proto_message,
+                          const lang_proto::ProtoExtractor& proto_extractor,
+                          proto::CompilationUnit schema_unit,
+                          IndexWriter* kzip_writer) {
+  auto textproto_digest = kzip_writer->WriteFile(textproto);
+  if (!textproto_digest.ok()) {
+    return textproto_digest.status();
+  }
+  proto::IndexedCompilation compilation;
+  *compilation.mutable_unit() = std::move(schema_unit);
+  AddTextprotoToUnit(textproto_filename, *textproto_digest, proto_message,
+                     proto_extractor, compilation.mutable_unit());
+
+  // Save compilation unit.
+  auto digest = kzip_writer->WriteUnit(compilation);
+  if (!digest.ok()) {
+    return digest.status();
+  }
+  return OkStatus();
+}
+
+/// \brief Reads the textproto filenames listed in the manifest at `path`.
+StatusOr<std::vector<std::string>> ReadBatchManifest(const std::string& path) {
+  std::ifstream manifest(path);
+  if (!manifest) {
+    return NotFoundError(absl::StrCat("Couldn't open batch manifest ", path));
+  }
+  std::vector<std::string> textproto_filenames;
+  std::string line;
+  while (std::getline(manifest, line)) {
+    absl::string_view stripped = absl::StripAsciiWhitespace(line);
+    if (!stripped.empty() && !absl::StartsWith(stripped, "#")) {
+      textproto_filenames.emplace_back(stripped);
+    }
+  }
+  if (textproto_filenames.empty()) {
+    return InvalidArgumentError(
+        absl::StrCat("No textprotos in batch manifest ", path));
+  }
+  return textproto_filenames;
 }
 
-// Loads all data from a file or terminates the process.
-std::string LoadFileOrDie(const std::string& file) {
-  FILE* handle = fopen(file.c_str(), "rb");
-  CHECK(handle != nullptr) << "Couldn't open input file " << file;
-  CHECK_EQ(fseek(handle, 0, SEEK_END), 0) << "Couldn't seek " << file;
-  long size = ftell(handle);
-  CHECK_GE(size, 0) << "Bad size for " << file;
-  CHECK_EQ(fseek(handle, 0, SEEK_SET), 0) << "Couldn't seek " << file;
-  std::string content;
-  content.resize(size);
-  CHECK_EQ(fread(&content[0], size, 1, handle), 1) << "Couldn't read " << file;
-  CHECK_NE(fclose(handle), EOF) << "Couldn't close " << file;
-  return content;
+/// \brief Writes a compilation unit for each of `textproto_filenames` to
+/// `kzip_writer`, in order. The protos of each distinct schema are extracted,
+/// hashed and written once, however many textprotos use it. Stops at the first
+/// textproto that fails, returning its error.
+Status ExtractTextprotoBatch(
+    const std::vector<std::string>& textproto_filenames,
+    const lang_proto::ProtoExtractor& proto_extractor,
+    IndexWriter* kzip_writer) {
+  // Proto files of a schema, joined -> the unit extracted for them.
+  absl::flat_hash_map<std::string, proto::CompilationUnit> schema_units;
+  // Disk path -> digest of each proto file written so far.
+  absl::flat_hash_map<std::string, std::string> written_files;
+  for (const std::string& textproto_filename : textproto_filenames) {
+    auto textproto =
+        ReadTextproto(textproto_filename, proto_extractor.file_cache);
+    if (!textproto.ok()) {
+      return textproto.status();
+    }
+    auto schema = ResolveSchema(textproto_filename, *textproto);
+    if (!schema.ok()) {
+      return schema.status();
+    }
+    std::vector<std::string> proto_filenames = SchemaProtoFiles(*schema);
+    std::string schema_key = absl::StrJoin(proto_filenames, ",");
+    auto schema_unit = schema_units.find(schema_key);
+    if (schema_unit == schema_units.end()) {
+      auto extraction = proto_extractor.Extract(proto_filenames);
+      if (!extraction.ok()) {
+        return extraction.status();
+      }
+      auto unit = lang_proto::ProtoExtractor::WriteExtraction(
+          std::move(*extraction), kzip_writer, &written_files);
+      if (!unit.ok()) {
+        return unit.status();
+      }
+      schema_unit =
+          schema_units.emplace(std::move(schema_key), std::move(*unit)).first;
+    }
+    Status status = WriteTextprotoUnit(
+        textproto_filename, *textproto, schema->proto_message,
+        proto_extractor, schema_unit->second, kzip_writer);
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  return OkStatus();
+}
+
+/// \brief Extracts the textproto(s) that the positional `args` and the flags
+/// describe into a new kzip, with a copy of `base_proto_extractor` extracting
+/// the protos they depend on.
+Status ExtractToKzip(const std::vector<std::string>& args,
+                     const lang_proto::ProtoExtractor& base_proto_extractor) {
+  lang_proto::ProtoExtractor proto_extractor = base_proto_extractor;
+
+  // Parse --proto_path and -I args into a set of path substitution (search
+  // paths).
+  std::vector<std::string> textproto_args;
+  ::kythe::lang_proto::ParsePathSubstitutions(
+      args, &proto_extractor.path_substitutions, &textproto_args);
+
+  std::string output_file = FLAGS_output_file;
+  if (output_file.empty()) {
+    const char* env_output_file = getenv("KYTHE_OUTPUT_FILE");
+    if (env_output_file == nullptr) {
+      return InvalidArgumentError(
+          "Please specify an output kzip file with --output_file or the "
+          "KYTHE_OUTPUT_FILE environment variable.");
+    }
+    output_file = env_output_file;
+  }
+
+  if (!FLAGS_batch_manifest.empty()) {
+    if (!textproto_args.empty()) {
+      return InvalidArgumentError(
+          "No textproto arguments are allowed with --batch_manifest.");
+    }
+    auto textproto_filenames = ReadBatchManifest(FLAGS_batch_manifest);
+    if (!textproto_filenames.ok()) {
+      return textproto_filenames.status();
+    }
+    auto kzip_writer = KzipWriter::Create(output_file);
+    if (!kzip_writer.ok()) {
+      return kzip_writer.status();
+    }
+    Status status = ExtractTextprotoBatch(*textproto_filenames,
+                                          proto_extractor, &*kzip_writer);
+    if (!status.ok()) {
+      return status;
+    }
+    return kzip_writer->Close();
+  }
+
+  // Load textproto.
+  if (textproto_args.size() != 1) {
+    return InvalidArgumentError(absl::StrCat("Expected 1 textproto file, got ",
+                                             textproto_args.size()));
+  }
+  const std::string& textproto_filename = textproto_args[0];
+  auto textproto =
+      ReadTextproto(textproto_filename, proto_extractor.file_cache);
+  if (!textproto.ok()) {
+    return textproto.status();
+  }
+  auto schema = ResolveSchema(textproto_filename, *textproto);
+  if (!schema.ok()) {
+    return schema.status();
+  }
+  auto kzip_writer = KzipWriter::Create(output_file);
+  if (!kzip_writer.ok()) {
+    return kzip_writer.status();
+  }
+
+  // Call the proto extractor. This adds proto_file and all of its dependencies
+  // into the kzip/unit, which we'll later need when indexing the textproto.
+  auto schema_unit =
+      proto_extractor.ExtractProtos(SchemaProtoFiles(*schema), &*kzip_writer);
+  if (!schema_unit.ok()) {
+    return schema_unit.status();
+  }
+  Status status = WriteTextprotoUnit(
+      textproto_filename, *textproto, schema->proto_message, proto_extractor,
+      std::move(*schema_unit), &*kzip_writer);
+  if (!status.ok()) {
+    return status;
+  }
+  return kzip_writer->Close();
 }
 
 }  // namespace
@@ -86,106 +366,49 @@ with specially-formatted comments in the textproto itself:
   # proto-message: some_namespace.MyMessage
   # proto-import: some/proto/with/extensions.proto
 
+With --persistent_worker, serves Bazel persistent worker requests on stdin and
+stdout, each holding the arguments of one extraction (including --output_file).
+The vname configuration is loaded once, and unchanged files are read once.
+
 Examples:
   export KYTHE_OUTPUT_FILE=foo.kzip
   textproto_extractor foo.pbtxt
   textproto_extractor foo.pbtxt --proto_message MyMessage --proto_files foo.proto,bar.proto
-  textproto_extractor foo.pbtxt --proto_message MyMessage --proto_files foo.proto -- --proto_path dir/with/my/deps")");
+  textproto_extractor foo.pbtxt --proto_message MyMessage --proto_files foo.proto -- --proto_path dir/with/my/deps
+  textproto_extractor --batch_manifest=textprotos.txt -- --proto_path dir/with/my/deps
+  textproto_extractor --persistent_worker")");
+  bool persistent_worker = IsPersistentWorker(argc, argv);
   gflags::ParseCommandLineFlags(&argc, &argv, /*remove_flags=*/true);
   std::vector<std::string> final_args(argv + 1, argv + argc);
 
   lang_proto::ProtoExtractor proto_extractor;
   proto_extractor.ConfigureFromEnv();
 
-  // Parse --proto_path and -I args into a set of path substitution (search
-  // paths).
-  std::vector<std::string> textproto_args;
-  ::kythe::lang_proto::ParsePathSubstitutions(
-      final_args, &proto_extractor.path_substitutions, &textproto_args);
-
-  // Load textproto.
-  CHECK(textproto_args.size() == 1)
-      << "Expected 1 textproto file, got " << textproto_args.size();
-  std::string textproto_filename = textproto_args[0];
-  std::string textproto = LoadFileOrDie(textproto_filename);
-
-  const char* output_file = getenv("KYTHE_OUTPUT_FILE");
-  CHECK(output_file != nullptr)
-      << "Please specify an output kzip file with the KYTHE_OUTPUT_FILE "
-         "environment variable.";
-  IndexWriter kzip_writer = OpenKzipWriterOrDie(output_file);
-
-  // Info about the textproto's corresponding proto can come from comments in
-  // the textproto itself or as command line flags to the extractor. Note that
-  // if metadata is specified both in the textproto and via flags, flags take
-  // precedence.
-  TextprotoSchema schema = ParseTextprotoSchemaComments(textproto);
-  std::vector<std::string> proto_filenames;
-  if (!FLAGS_proto_files.empty()) {
-    proto_filenames = absl::StrSplit(FLAGS_proto_files, ',');
-  } else {
-    proto_filenames.push_back(schema.proto_file);
-    for (const auto& extra_import : schema.proto_imports) {
-      proto_filenames.push_back(extra_import);
-    }
+  if (persistent_worker) {
+    CHECK(final_args.empty())
+        << "No positional arguments are allowed with --persistent_worker.";
+    lang_proto::FileCache file_cache;
+    proto_extractor.file_cache = &file_cache;
+    // Failed requests are reported in their responses, leaving the worker
+    // and its caches to serve the next.
+    bool served = RunPersistentWorker(
+        STDIN_FILENO, STDOUT_FILENO,
+        [&](const std::vector<std::string>& args, std::string* output) {
+          Status status = ExtractToKzip(args, proto_extractor);
+          if (!status.ok()) {
+            *output = status.ToString();
+            return 1;
+          }
+          return 0;
+        });
+    return served ? 0 : 1;
   }
-  if (!FLAGS_proto_message.empty()) {
-    schema.proto_message = FLAGS_proto_message;
-  }
-  CHECK(!proto_filenames.empty())
-      << "Proto file must be specified either with --proto_files flag or in "
-         "textproto comments";
-  CHECK(!schema.proto_message.empty())
-      << "Proto message must be specified either with --proto_message flag or "
-         "in textproto comments";
-
-  // Call the proto extractor. This adds proto_file and all of its dependencies
-  // into the kzip/unit, which we'll later need when indexing the textproto.
-  proto::IndexedCompilation compilation;
-  *compilation.mutable_unit() =
-      proto_extractor.ExtractProtos(proto_filenames, &kzip_writer);
-
-  // Replace the proto extractor's source file list with our textproto.
-  compilation.mutable_unit()->clear_source_file();
-  compilation.mutable_unit()->add_source_file(textproto_filename);
 
-  // Re-build compilation unit's arguments list. Add --proto_message and any
-  // protoc args.
-  compilation.mutable_unit()->clear_argument();
-  compilation.mutable_unit()->add_argument(textproto_filename);
-  compilation.mutable_unit()->add_argument("--proto_message");
-  compilation.mutable_unit()->add_argument(schema.proto_message);
-  // Add protoc args.
-  if (!proto_extractor.path_substitutions.empty()) {
-    compilation.mutable_unit()->add_argument("--");
-    for (auto& arg : lang_proto::PathSubstitutionsToArgs(
-             proto_extractor.path_substitutions)) {
-      compilation.mutable_unit()->add_argument(arg);
-    }
+  Status status = ExtractToKzip(final_args, proto_extractor);
+  if (!status.ok()) {
+    LOG(ERROR) << status.ToString();
+    return 1;
   }
-
-  // Add textproto file to kzip.
-  {
-    auto digest = kzip_writer.WriteFile(textproto);
-    CHECK(digest.ok()) << digest.status();
-
-    proto::CompilationUnit::FileInput* file_input =
-        compilation.mutable_unit()->add_required_input();
-    proto::VName vname =
-        proto_extractor.vname_gen.LookupVName(textproto_filename);
-    if (vname.corpus().empty()) {
-      vname.set_corpus(proto_extractor.corpus);
-    }
-    *file_input->mutable_v_name() = std::move(vname);
-    file_input->mutable_info()->set_path(textproto_filename);
-    file_input->mutable_info()->set_digest(*digest);
-  }
-
-  // Save compilation unit.
-  auto digest = kzip_writer.WriteUnit(compilation);
-  CHECK(digest.ok()) << "Error writing unit to kzip: " << digest.status();
-  CHECK(kzip_writer.Close().ok());
-
   return 0;
 }
 
@@ -0,0 +1,140 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/extractor/worker/persistent_worker.h"
+
+#include <cstring>
+
+#include "gflags/gflags.h"
+#include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "google/protobuf/util/delimited_message_util.h"
+#include "kythe/cxx/extractor/worker/worker_protocol.pb.h"
+
+DEFINE_bool(persistent_worker, false,
+            "Serve Bazel persistent worker requests on stdin and stdout.");
+
+namespace kythe {
+namespace {
+
+// Sets the gflags among `args` and appends the remaining (positional)
+// arguments to `positional`, as gflags::ParseCommandLineNonHelpFlags() would,
+// but returns false with a message in `error` on an unknown flag or a bad
+// value rather than exiting the process.
+bool ParseFlags(const std::vector<std::string>& args,
+                std::vector<std::string>* positional, std::string* error) {
+  for (size_t i = 0; i < args.size(); ++i) {
+    const std::string& arg = args[i];
+    if (arg == "--") {
+      positional->insert(positional->end(), args.begin() + i + 1, args.end());
+      break;
+    }
+    if (arg.size() < 2 || arg[0] != '-') {
+      positional->push_back(arg);
+      continue;
+    }
+    std::string name = arg.substr(arg[1] == '-' ? 2 : 1);
+    std::string value;
+    bool has_value = false;
+    std::string::size_type equals = name.find('=');
+    if (equals != std::string::npos) {
+      value = name.substr(equals + 1);
+      name.resize(equals);
+      has_value = true;
+    }
+    gflags::CommandLineFlagInfo info;
+    if (!gflags::GetCommandLineFlagInfo(name.c_str(), &info)) {
+      // --nofoo sets the boolean flag --foo to false.
+      if (has_value || name.compare(0, 2, "no") != 0 ||
+          !gflags::GetCommandLineFlagInfo(name.c_str() + 2, &info) ||
+          info.type != "bool") {
+        *error = "Unknown command line flag '" + name + "'";
+        return false;
+      }
+      name = info.name;
+      value = "false";
+      has_value = true;
+    }
+    if (!has_value) {
+      if (info.type == "bool") {
+        value = "true";
+      } else if (i + 1 < args.size()) {
+        value = args[++i];
+      } else {
+        *error = "Flag '" + name + "' is missing its argument";
+        return false;
+      }
+    }
+    if (gflags::SetCommandLineOption(name.c_str(), value.c_str()).empty()) {
+      *error = "Illegal value '" + value + "' specified for flag '" + name +
+               "'";
+      return false;
+    }
+  }
+  return true;
+}
+
+// Parses the gflags among `args` and calls `handler` with the rest, then
+// restores all flags to their previous values. A request whose flags can't be
+// parsed fails without calling `handler`.
+int RunWithFlags(const std::vector<std::string>& args,
+                 const WorkHandler& handler, std::string* output) {
+  gflags::FlagSaver saved_flags;
+  std::vector<std::string> positional;
+  if (!ParseFlags(args, &positional, output)) {
+    return 1;
+  }
+  return handler(positional, output);
+}
+
+}  // namespace
+
+bool IsPersistentWorker(int argc, char** argv) {
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--persistent_worker") == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool RunPersistentWorker(int input_fd, int output_fd,
+                         const WorkHandler& handler) {
+  google::protobuf::io::FileInputStream input(input_fd);
+  while (true) {
+    blaze::worker::WorkRequest request;
+    bool clean_eof = false;
+    if (!google::protobuf::util::ParseDelimitedFromZeroCopyStream(
+            &request, &input, &clean_eof)) {
+      return clean_eof;
+    }
+
+    blaze::worker::WorkResponse response;
+    response.set_request_id(request.request_id());
+    std::vector<std::string> args(request.arguments().begin(),
+                                  request.arguments().end());
+    response.set_exit_code(
+        RunWithFlags(args, handler, response.mutable_output()));
+
+    google::protobuf::io::FileOutputStream output(output_fd);
+    if (!google::protobuf::util::SerializeDelimitedToZeroCopyStream(
+            response, &output) ||
+        !output.Flush()) {
+      return false;
+    }
+  }
+}
+
+}  // namespace kythe
@@ -0,0 +1,55 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KYTHE_CXX_EXTRACTOR_WORKER_PERSISTENT_WORKER_H_
+#define KYTHE_CXX_EXTRACTOR_WORKER_PERSISTENT_WORKER_H_
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace kythe {
+
+/// Handles a single work request. `args` are the request's arguments, which
+/// are those of a one-shot run of the tool (without argv[0]). Anything
+/// written to `output` is reported back with the response. Returns the exit
+/// code of the request.
+using WorkHandler = std::function<int(const std::vector<std::string>& args,
+                                      std::string* output)>;
+
+/// \brief Returns whether the command line `argv` asks for the tool to run as
+/// a persistent worker, which Bazel does with --persistent_worker. The flag is
+/// defined alongside, so it is accepted when `argv` is parsed.
+bool IsPersistentWorker(int argc, char** argv);
+
+/// \brief Serves Bazel persistent worker requests: reads length-delimited
+/// WorkRequests from `input_fd` and answers each with a WorkResponse on
+/// `output_fd`, until `input_fd` is closed.
+///
+/// The gflags among each request's arguments are parsed before `handler` is
+/// called with the remaining (positional) arguments, and restored to their
+/// previous values afterwards. A request with an unknown flag or a bad flag
+/// value fails with exit code 1 and the error as its output, without calling
+/// `handler`; the worker goes on serving. State the tool keeps outside of
+/// `handler` (such as loaded configuration and caches) lives on across
+/// requests; that is the point of a persistent worker. Returns false if a
+/// request could not be read or a response could not be written.
+bool RunPersistentWorker(int input_fd, int output_fd,
+                         const WorkHandler& handler);
+
+}  // namespace kythe
+
+#endif  // KYTHE_CXX_EXTRACTOR_WORKER_PERSISTENT_WORKER_H_
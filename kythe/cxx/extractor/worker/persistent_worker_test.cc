@@ -0,0 +1,171 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/extractor/worker/persistent_worker.h"
+
+#include <unistd.h>
+
+#include "gflags/gflags.h"
+#include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "google/protobuf/util/delimited_message_util.h"
+#include "gtest/gtest.h"
+#include "kythe/cxx/extractor/worker/worker_protocol.pb.h"
+
+DEFINE_int32(test_count, 0, "A flag for the requests below to set.");
+DEFINE_bool(test_verbose, false, "A flag for the requests below to set.");
+
+namespace kythe {
+namespace {
+
+using ::blaze::worker::WorkRequest;
+using ::blaze::worker::WorkResponse;
+
+// Writes `requests` to a pipe and returns its read end.
+int PipeRequests(const std::vector<WorkRequest>& requests) {
+  int fds[2];
+  EXPECT_EQ(pipe(fds), 0);
+  {
+    google::protobuf::io::FileOutputStream output(fds[1]);
+    for (const auto& request : requests) {
+      EXPECT_TRUE(google::protobuf::util::SerializeDelimitedToZeroCopyStream(
+          request, &output));
+    }
+  }
+  close(fds[1]);
+  return fds[0];
+}
+
+// Reads all the responses from `fd`.
+std::vector<WorkResponse> ReadResponses(int fd) {
+  std::vector<WorkResponse> responses;
+  google::protobuf::io::FileInputStream input(fd);
+  bool clean_eof = false;
+  while (true) {
+    // Parsing merges into the message, so each response needs a fresh one.
+    WorkResponse response;
+    if (!google::protobuf::util::ParseDelimitedFromZeroCopyStream(
+            &response, &input, &clean_eof)) {
+      break;
+    }
+    responses.push_back(std::move(response));
+  }
+  EXPECT_TRUE(clean_eof);
+  return responses;
+}
+
+TEST(PersistentWorkerTest, AnswersEachRequest) {
+  std::vector<WorkRequest> requests(2);
+  requests[0].add_arguments("good.proto");
+  requests[0].set_request_id(1);
+  requests[1].add_arguments("bad.proto");
+  requests[1].add_arguments("extra");
+  requests[1].set_request_id(2);
+  int input_fd = PipeRequests(requests);
+  int output_fds[2];
+  ASSERT_EQ(pipe(output_fds), 0);
+
+  int handled = 0;
+  EXPECT_TRUE(RunPersistentWorker(
+      input_fd, output_fds[1],
+      [&](const std::vector<std::string>& args, std::string* output) {
+        ++handled;
+        if (args.size() == 1) {
+          return 0;
+        }
+        *output = "too many arguments";
+        return 1;
+      }));
+  close(input_fd);
+  close(output_fds[1]);
+
+  std::vector<WorkResponse> responses = ReadResponses(output_fds[0]);
+  close(output_fds[0]);
+  EXPECT_EQ(handled, 2);
+  ASSERT_EQ(responses.size(), 2u);
+  EXPECT_EQ(responses[0].request_id(), 1);
+  EXPECT_EQ(responses[0].exit_code(), 0);
+  EXPECT_EQ(responses[1].request_id(), 2);
+  EXPECT_EQ(responses[1].exit_code(), 1);
+  EXPECT_EQ(responses[1].output(), "too many arguments");
+}
+
+TEST(PersistentWorkerTest, ParsesFlagsPerRequest) {
+  std::vector<WorkRequest> requests(5);
+  for (size_t i = 0; i < requests.size(); ++i) {
+    requests[i].set_request_id(i + 1);
+  }
+  requests[0].add_arguments("--test_count=3");
+  requests[0].add_arguments("first.proto");
+  requests[0].add_arguments("--test_verbose");
+  requests[0].add_arguments("--");
+  requests[0].add_arguments("--proto_path");
+  requests[1].add_arguments("-test_count");
+  requests[1].add_arguments("5");
+  requests[1].add_arguments("--notest_verbose");
+  requests[2].add_arguments("--no_such_flag");
+  requests[2].add_arguments("third.proto");
+  requests[3].add_arguments("--test_count=many");
+  requests[4].add_arguments("last.proto");
+  int input_fd = PipeRequests(requests);
+  int output_fds[2];
+  ASSERT_EQ(pipe(output_fds), 0);
+
+  FLAGS_test_verbose = true;
+  std::vector<std::string> seen;
+  EXPECT_TRUE(RunPersistentWorker(
+      input_fd, output_fds[1],
+      [&](const std::vector<std::string>& args, std::string* output) {
+        std::string call = std::to_string(FLAGS_test_count) +
+                           (FLAGS_test_verbose ? " verbose" : " quiet");
+        for (const std::string& arg : args) {
+          call += " " + arg;
+        }
+        seen.push_back(call);
+        return 0;
+      }));
+  close(input_fd);
+  close(output_fds[1]);
+
+  std::vector<WorkResponse> responses = ReadResponses(output_fds[0]);
+  close(output_fds[0]);
+  // Flags apply to their own request only, and requests with bad flags fail
+  // without reaching the handler.
+  EXPECT_EQ(seen, std::vector<std::string>(
+                      {"3 verbose first.proto --proto_path", "5 quiet",
+                       "0 verbose last.proto"}));
+  EXPECT_EQ(FLAGS_test_count, 0);
+  EXPECT_TRUE(FLAGS_test_verbose);
+  ASSERT_EQ(responses.size(), 5u);
+  EXPECT_EQ(responses[0].exit_code(), 0);
+  EXPECT_EQ(responses[1].exit_code(), 0);
+  EXPECT_EQ(responses[2].exit_code(), 1);
+  EXPECT_EQ(responses[2].output(), "Unknown command line flag 'no_such_flag'");
+  EXPECT_EQ(responses[3].exit_code(), 1);
+  EXPECT_EQ(responses[3].output(),
+            "Illegal value 'many' specified for flag 'test_count'");
+  EXPECT_EQ(responses[4].exit_code(), 0);
+}
+
+TEST(PersistentWorkerTest, RecognizesWorkerFlag) {
+  char program[] = "extractor";
+  char flag[] = "--persistent_worker";
+  char* worker_argv[] = {program, flag};
+  EXPECT_TRUE(IsPersistentWorker(2, worker_argv));
+  EXPECT_FALSE(IsPersistentWorker(1, worker_argv));
+}
+
+}  // namespace
+}  // namespace kythe
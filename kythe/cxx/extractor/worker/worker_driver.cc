@@ -0,0 +1,150 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Stand-in for Bazel's side of the persistent worker protocol, for trying out
+// and testing workers locally. Starts the given command as a persistent
+// worker, sends it one WorkRequest per line of the requests file (holding the
+// request's whitespace-separated arguments) and prints each response.
+//
+// Usage:
+//   worker_driver --requests=requests.txt -- proto_extractor
+//
+// Exits with 1 if any request fails.
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/str_split.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "google/protobuf/util/delimited_message_util.h"
+#include "kythe/cxx/extractor/worker/worker_protocol.pb.h"
+
+DEFINE_string(requests, "",
+              "File holding the arguments of one request per line.");
+
+namespace kythe {
+namespace {
+
+/// \brief Starts `command` as a persistent worker, with `*to_worker` and
+/// `*from_worker` set to the ends of its stdin and stdout. Returns its pid.
+pid_t StartWorker(const std::vector<std::string>& command, int* to_worker,
+                  int* from_worker) {
+  int request_pipe[2];
+  int response_pipe[2];
+  CHECK_EQ(pipe(request_pipe), 0);
+  CHECK_EQ(pipe(response_pipe), 0);
+  pid_t pid = fork();
+  CHECK_GE(pid, 0) << "Couldn't fork";
+  if (pid == 0) {
+    CHECK_GE(dup2(request_pipe[0], STDIN_FILENO), 0);
+    CHECK_GE(dup2(response_pipe[1], STDOUT_FILENO), 0);
+    close(request_pipe[0]);
+    close(request_pipe[1]);
+    close(response_pipe[0]);
+    close(response_pipe[1]);
+    std::vector<std::string> args = command;
+    args.push_back("--persistent_worker");
+    std::vector<char*> argv;
+    for (std::string& arg : args) {
+      argv.push_back(&arg[0]);
+    }
+    argv.push_back(nullptr);
+    execvp(argv[0], argv.data());
+    LOG(FATAL) << "Couldn't run " << command[0];
+  }
+  close(request_pipe[0]);
+  close(response_pipe[1]);
+  *to_worker = request_pipe[1];
+  *from_worker = response_pipe[0];
+  return pid;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  google::InitGoogleLogging(argv[0]);
+  gflags::SetUsageMessage(R"(Drives a persistent worker locally.
+Sends the worker started with the positional arguments one request for each
+line of the --requests file and prints the responses.
+
+Example:
+  worker_driver --requests=requests.txt -- proto_extractor)");
+  gflags::ParseCommandLineFlags(&argc, &argv, /*remove_flags=*/true);
+  std::vector<std::string> command(argv + 1, argv + argc);
+  CHECK(!command.empty()) << "Expected a worker command.";
+
+  std::ifstream requests_file(FLAGS_requests);
+  CHECK(requests_file) << "Couldn't open requests file " << FLAGS_requests;
+
+  int to_worker, from_worker;
+  pid_t pid = StartWorker(command, &to_worker, &from_worker);
+  google::protobuf::io::FileInputStream responses(from_worker);
+
+  bool had_error = false;
+  int request_id = 0;
+  std::string line;
+  while (std::getline(requests_file, line)) {
+    if (absl::StripAsciiWhitespace(line).empty()) {
+      continue;
+    }
+    blaze::worker::WorkRequest request;
+    request.set_request_id(++request_id);
+    for (absl::string_view arg :
+         absl::StrSplit(line, absl::ByAnyChar(" \t"), absl::SkipEmpty())) {
+      request.add_arguments(std::string(arg));
+    }
+    {
+      google::protobuf::io::FileOutputStream output(to_worker);
+      CHECK(google::protobuf::util::SerializeDelimitedToZeroCopyStream(
+                request, &output) &&
+            output.Flush())
+          << "Couldn't send request " << request_id;
+    }
+
+    blaze::worker::WorkResponse response;
+    CHECK(google::protobuf::util::ParseDelimitedFromZeroCopyStream(
+        &response, &responses, nullptr))
+        << "No response to request " << request_id;
+    CHECK_EQ(response.request_id(), request_id);
+    std::cout << "request " << request_id << ": exit code "
+              << response.exit_code() << std::endl;
+    if (!response.output().empty()) {
+      std::cout << response.output() << std::endl;
+    }
+    had_error |= response.exit_code() != 0;
+  }
+
+  // Closing the worker's stdin tells it to exit.
+  close(to_worker);
+  int status;
+  CHECK_EQ(waitpid(pid, &status, 0), pid);
+  close(from_worker);
+  CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0)
+      << "Worker exited abnormally";
+  return had_error ? 1 : 0;
+}
+
+}  // namespace kythe
+
+int main(int argc, char* argv[]) { return kythe::main(argc, argv); }
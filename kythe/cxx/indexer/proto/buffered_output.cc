@@ -0,0 +1,57 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/indexer/proto/buffered_output.h"
+
+namespace kythe {
+
+void BufferedOutputStream::Emit(const FactRef& fact) {
+  entries_.emplace_back();
+  fact.Expand(&entries_.back());
+}
+
+void BufferedOutputStream::Emit(const EdgeRef& edge) {
+  entries_.emplace_back();
+  edge.Expand(&entries_.back());
+}
+
+void BufferedOutputStream::Emit(const OrdinalEdgeRef& edge) {
+  entries_.emplace_back();
+  edge.Expand(&entries_.back());
+}
+
+std::vector<proto::Entry> BufferedOutputStream::TakeEntries() {
+  std::vector<proto::Entry> entries;
+  entries.swap(entries_);
+  return entries;
+}
+
+void EmitEntries(const std::vector<proto::Entry>& entries,
+                 KytheOutputStream* output) {
+  for (const proto::Entry& entry : entries) {
+    VNameRef source(entry.source());
+    if (entry.edge_kind().empty()) {
+      output->Emit(FactRef{&source, entry.fact_name(), entry.fact_value()});
+    } else {
+      // Ordinal edges were expanded with the ordinal appended to their kind,
+      // so they are written back as plain edges with the same entry.
+      VNameRef target(entry.target());
+      output->Emit(EdgeRef{&source, entry.edge_kind(), &target});
+    }
+  }
+}
+
+}  // namespace kythe
@@ -0,0 +1,56 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KYTHE_CXX_INDEXER_PROTO_BUFFERED_OUTPUT_H_
+#define KYTHE_CXX_INDEXER_PROTO_BUFFERED_OUTPUT_H_
+
+#include <vector>
+
+#include "kythe/cxx/common/indexing/KytheOutputStream.h"
+#include "kythe/proto/storage.pb.h"
+
+namespace kythe {
+
+// A KytheOutputStream that keeps everything emitted to it in memory, so that
+// output produced concurrently can be written out later in a fixed order.
+class BufferedOutputStream : public KytheOutputStream {
+ public:
+  BufferedOutputStream() = default;
+
+  // disallow copy and assign
+  BufferedOutputStream(const BufferedOutputStream&) = delete;
+  void operator=(const BufferedOutputStream&) = delete;
+
+  void Emit(const FactRef& fact) override;
+  void Emit(const EdgeRef& edge) override;
+  void Emit(const OrdinalEdgeRef& edge) override;
+
+  // Returns the entries emitted since the last call, leaving the buffer
+  // empty.
+  std::vector<proto::Entry> TakeEntries();
+
+ private:
+  std::vector<proto::Entry> entries_;
+};
+
+// Writes `entries`, as returned by BufferedOutputStream::TakeEntries(), to
+// `output` in order.
+void EmitEntries(const std::vector<proto::Entry>& entries,
+                 KytheOutputStream* output);
+
+}  // namespace kythe
+
+#endif  // KYTHE_CXX_INDEXER_PROTO_BUFFERED_OUTPUT_H_
@@ -0,0 +1,109 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/indexer/proto/buffered_output.h"
+
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace kythe {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::ElementsAreArray;
+using ::testing::IsEmpty;
+
+proto::VName MakeVName(const std::string& signature) {
+  proto::VName vname;
+  vname.set_corpus("corpus");
+  vname.set_path("file.proto");
+  vname.set_signature(signature);
+  return vname;
+}
+
+// Returns `entries` serialized, for comparison.
+std::vector<std::string> Serialize(const std::vector<proto::Entry>& entries) {
+  std::vector<std::string> serialized;
+  for (const proto::Entry& entry : entries) {
+    serialized.push_back(entry.SerializeAsString());
+  }
+  return serialized;
+}
+
+// Emits a fact, an edge, and an ordinal edge to `output`.
+void EmitGraph(KytheOutputStream* output) {
+  proto::VName source_vname = MakeVName("source");
+  proto::VName target_vname = MakeVName("target");
+  VNameRef source(source_vname);
+  VNameRef target(target_vname);
+  output->Emit(FactRef{&source, "/kythe/node/kind", "record"});
+  output->Emit(EdgeRef{&source, "/kythe/edge/childof", &target});
+  output->Emit(OrdinalEdgeRef{&source, "/kythe/edge/param", &target, 2});
+}
+
+TEST(BufferedOutputTest, TakeEntriesEmptiesBuffer) {
+  BufferedOutputStream buffer;
+  EmitGraph(&buffer);
+  EXPECT_EQ(buffer.TakeEntries().size(), 3);
+  EXPECT_THAT(buffer.TakeEntries(), IsEmpty());
+}
+
+TEST(BufferedOutputTest, OrdinalEdgeKeepsOrdinal) {
+  BufferedOutputStream buffer;
+  EmitGraph(&buffer);
+  std::vector<proto::Entry> entries = buffer.TakeEntries();
+  ASSERT_EQ(entries.size(), 3);
+  EXPECT_EQ(entries[2].edge_kind(), "/kythe/edge/param.2");
+}
+
+// Writing buffered entries must produce the same entries as emitting them
+// directly, including ordinal edges, which are written back as plain edges.
+TEST(BufferedOutputTest, EmitEntriesMatchesDirectOutput) {
+  BufferedOutputStream direct;
+  EmitGraph(&direct);
+  std::vector<proto::Entry> expected = direct.TakeEntries();
+
+  BufferedOutputStream buffer;
+  EmitGraph(&buffer);
+  BufferedOutputStream replayed;
+  EmitEntries(buffer.TakeEntries(), &replayed);
+  EXPECT_THAT(Serialize(replayed.TakeEntries()),
+              ElementsAreArray(Serialize(expected)));
+}
+
+TEST(BufferedOutputTest, EmitEntriesKeepsOrder) {
+  proto::VName first_vname = MakeVName("first");
+  proto::VName second_vname = MakeVName("second");
+  VNameRef first(first_vname);
+  VNameRef second(second_vname);
+  BufferedOutputStream buffer;
+  buffer.Emit(FactRef{&second, "/kythe/text", "2"});
+  buffer.Emit(FactRef{&first, "/kythe/text", "1"});
+
+  BufferedOutputStream replayed;
+  EmitEntries(buffer.TakeEntries(), &replayed);
+  std::vector<proto::Entry> entries = replayed.TakeEntries();
+  ASSERT_EQ(entries.size(), 2);
+  EXPECT_THAT(std::vector<std::string>(
+                  {entries[0].fact_value(), entries[1].fact_value()}),
+              ElementsAre("2", "1"));
+}
+
+}  // namespace
+}  // namespace kythe
@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+# Copyright 2019 The Kythe Authors. All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+"""Writes a C++ source file defining the data in well_known_types_data.h.
+
+The serialized FileDescriptorSet given by --descriptor_set is embedded
+verbatim, along with the SHA-256 digest of each of the .proto sources it
+was compiled from, named relative to --proto_path.
+"""
+
+import argparse
+import hashlib
+import os
+
+_HEADER = """// Generated by embed_descriptor_set.py. Do not edit.
+
+#include "kythe/cxx/indexer/proto/well_known_types_data.h"
+
+namespace kythe {
+"""
+
+_FOOTER = """
+}  // namespace kythe
+"""
+
+
+def _escape(data):
+  """Returns `data` as the body of a C++ string literal."""
+  return "".join("\\%03o" % byte for byte in data)
+
+
+def main():
+  parser = argparse.ArgumentParser(description=__doc__)
+  parser.add_argument("--descriptor_set", required=True)
+  parser.add_argument("--proto_path", required=True)
+  parser.add_argument("--output", required=True)
+  parser.add_argument("sources", nargs="+")
+  args = parser.parse_args()
+
+  with open(args.descriptor_set, "rb") as f:
+    descriptor_set = f.read()
+  files = []
+  for source in sorted(args.sources):
+    with open(source, "rb") as f:
+      digest = hashlib.sha256(f.read()).hexdigest()
+    files.append((os.path.relpath(source, args.proto_path), digest))
+
+  with open(args.output, "w") as out:
+    out.write(_HEADER)
+    out.write("\nconst char kWellKnownTypesDescriptorSet[] =\n")
+    for start in range(0, len(descriptor_set), 16):
+      out.write('    "%s"\n' % _escape(descriptor_set[start:start + 16]))
+    out.write(";\n")
+    out.write("const size_t kWellKnownTypesDescriptorSetSize = %d;\n" %
+              len(descriptor_set))
+    out.write("\nconst EmbeddedProtoFile kWellKnownTypesFiles[] = {\n")
+    for name, digest in files:
+      out.write('    {"%s", "%s"},\n' % (name, digest))
+    out.write("};\n")
+    out.write("const size_t kWellKnownTypesFileCount = %d;\n" % len(files))
+    out.write(_FOOTER)
+
+
+if __name__ == "__main__":
+  main()
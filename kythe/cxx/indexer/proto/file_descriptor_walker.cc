@@ -27,6 +27,7 @@
 #include "kythe/cxx/common/status_or.h"
 #include "kythe/cxx/indexer/proto/marked_source.h"
 #include "kythe/cxx/indexer/proto/proto_graph_builder.h"
+#include "kythe/cxx/indexer/proto/type_name_scanner.h"
 #include "re2/re2.h"
 #include "re2/stringpiece.h"
 
@@ -276,33 +277,33 @@ void FileDescriptorWalker::VisitImports() {
   {
     // Direct dependencies, from `import "foo.proto"` statements.
     std::vector<int> path = {FileDescriptorProto::kDependencyFieldNumber};
-    for (int i = 0; i < file_descriptor_->dependency_count(); i++) {
+    for (int i = 0; i < file_proto_->dependency_size(); i++) {
       ScopedLookup import_lookup(&path, i);
       Location location;
       InitializeLocation(location_map_[path], &location);
-      builder_->AddImport(file_descriptor_->dependency(i)->name(), location);
+      builder_->AddImport(file_proto_->dependency(i), location);
     }
   }
   {
     // Weak dependencies, from `import weak "foo.proto"` statements.
     std::vector<int> path = {FileDescriptorProto::kWeakDependencyFieldNumber};
-    for (int i = 0; i < file_descriptor_->weak_dependency_count(); i++) {
+    for (int i = 0; i < file_proto_->weak_dependency_size(); i++) {
       ScopedLookup import_lookup(&path, i);
       Location location;
       InitializeLocation(location_map_[path], &location);
-      builder_->AddImport(file_descriptor_->weak_dependency(i)->name(),
-                          location);
+      builder_->AddImport(
+          file_proto_->dependency(file_proto_->weak_dependency(i)), location);
     }
   }
   {
     // Public dependencies, from `import public "foo.proto"` statements
     std::vector<int> path = {FileDescriptorProto::kPublicDependencyFieldNumber};
-    for (int i = 0; i < file_descriptor_->public_dependency_count(); i++) {
+    for (int i = 0; i < file_proto_->public_dependency_size(); i++) {
       ScopedLookup import_lookup(&path, i);
       Location location;
       InitializeLocation(location_map_[path], &location);
-      builder_->AddImport(file_descriptor_->public_dependency(i)->name(),
-                          location);
+      builder_->AddImport(
+          file_proto_->dependency(file_proto_->public_dependency(i)), location);
     }
   }
 }
@@ -341,15 +342,15 @@ void FileDescriptorWalker::VisitField(const std::string* parent_name,
                                       const std::string& message_name,
                                       const VName& message,
                                       const FieldDescriptor* field,
-                                      std::vector<int> lookup_path) {
+                                      std::vector<int>* lookup_path) {
   std::string vname = absl::StrCat(message_name, ".", field->name());
   VName v_name = builder_->VNameForDescriptor(field);
-  AddComments(v_name, lookup_path);
+  AddComments(v_name, *lookup_path);
 
   {
     // Get location of declaration and add as Grok binding
-    ScopedLookup name_num(&lookup_path, FieldDescriptorProto::kNameFieldNumber);
-    const std::vector<int>& span = location_map_[lookup_path];
+    ScopedLookup name_num(lookup_path, FieldDescriptorProto::kNameFieldNumber);
+    const std::vector<int>& span = location_map_[*lookup_path];
     Location location;
     InitializeLocation(span, &location);
 
@@ -368,13 +369,13 @@ void FileDescriptorWalker::VisitField(const std::string* parent_name,
 
   Location type_location;
   {
-    ScopedLookup type_num(&lookup_path,
+    ScopedLookup type_num(lookup_path,
                           FieldDescriptorProto::kTypeNameFieldNumber);
-    if (location_map_.find(lookup_path) == location_map_.end()) {
+    if (location_map_.find(*lookup_path) == location_map_.end()) {
       // the type was primitive, ignore for now
       return;
     }
-    const std::vector<int>& type_span = location_map_[lookup_path];
+    const std::vector<int>& type_span = location_map_[*lookup_path];
     InitializeLocation(type_span, &type_location);
   }
   VName type = VNameForFieldType(field);
@@ -393,15 +394,12 @@ void FileDescriptorWalker::VisitField(const std::string* parent_name,
     VName valType = VNameForFieldType(field->message_type()->field(1));
     // Map key/value types do not have SourceCodeInfo locations; we have to find
     // them within the outer "map<...>" type location.
-    absl::string_view content = absl::string_view(content_);
-    absl::string_view type_name = content.substr(
+    absl::string_view type_name = content_.substr(
         type_location.begin, type_location.end - type_location.begin);
-    re2::StringPiece key, val;
-    if (RE2::FullMatch(ToStringPiece(type_name),
-                       R"(\s*map\s*<\s*(\S+)\s*,\s*(\S+)\s*>\s*)", &key,
-                       &val)) {
-      size_t key_start = key.data() - content.data();
-      size_t val_start = val.data() - content.data();
+    absl::string_view key, val;
+    if (FindMapTypeNames(type_name, &key, &val)) {
+      size_t key_start = key.data() - content_.data();
+      size_t val_start = val.data() - content_.data();
 
       builder_->AddReference(
           keyType, {type_location.file, key_start, key_start + key.size()});
@@ -415,10 +413,10 @@ void FileDescriptorWalker::VisitField(const std::string* parent_name,
     const EnumValueDescriptor* default_value = field->default_value_enum();
     VName value = builder_->VNameForDescriptor(default_value);
     // Find reference location
-    ScopedLookup default_num(&lookup_path,
+    ScopedLookup default_num(lookup_path,
                              FieldDescriptorProto::kDefaultValueFieldNumber);
 
-    const std::vector<int>& value_span = location_map_[lookup_path];
+    const std::vector<int>& value_span = location_map_[*lookup_path];
     Location value_location;
     InitializeLocation(value_span, &value_location);
     builder_->AddReference(value, value_location);
@@ -426,28 +424,23 @@ void FileDescriptorWalker::VisitField(const std::string* parent_name,
 }
 
 void FileDescriptorWalker::VisitFields(const std::string& message_name,
+                                       const VName& message,
                                        const Descriptor* dp,
-                                       std::vector<int> lookup_path) {
-  VName message = VNameForProtoPath(file_name_, lookup_path);
-  if (visited_messages_.find(URI(message).ToString()) !=
-      visited_messages_.end()) {
-    return;
-  }
-  visited_messages_.insert(URI(message).ToString());
+                                       std::vector<int>* lookup_path) {
   {
-    ScopedLookup field_num(&lookup_path, DescriptorProto::kFieldFieldNumber);
+    ScopedLookup field_num(lookup_path, DescriptorProto::kFieldFieldNumber);
     for (int i = 0; i < dp->field_count(); i++) {
-      ScopedLookup field_index(&lookup_path, i);
+      ScopedLookup field_index(lookup_path, i);
 
       VisitField(&message_name, &message, message_name, message, dp->field(i),
                  lookup_path);
     }
   }
   {
-    ScopedLookup extension_num(&lookup_path,
+    ScopedLookup extension_num(lookup_path,
                                DescriptorProto::kExtensionFieldNumber);
     for (int i = 0; i < dp->extension_count(); i++) {
-      ScopedLookup extension_index(&lookup_path, i);
+      ScopedLookup extension_index(lookup_path, i);
       VisitExtension(&message_name, &message, dp->extension(i), lookup_path);
     }
   }
@@ -456,23 +449,22 @@ void FileDescriptorWalker::VisitFields(const std::string& message_name,
 void FileDescriptorWalker::VisitNestedEnumTypes(const std::string& message_name,
                                                 const VName* message,
                                                 const Descriptor* dp,
-                                                std::vector<int> lookup_path) {
-  ScopedLookup enum_num(&lookup_path, DescriptorProto::kEnumTypeFieldNumber);
+                                                std::vector<int>* lookup_path) {
+  ScopedLookup enum_num(lookup_path, DescriptorProto::kEnumTypeFieldNumber);
   for (int i = 0; i < dp->enum_type_count(); i++) {
     const EnumDescriptor* nested_proto = dp->enum_type(i);
 
     // Get the path that corresponds to the name of the enum
-    ScopedLookup enum_index(&lookup_path, i);
+    ScopedLookup enum_index(lookup_path, i);
 
     std::string vname = absl::StrCat(message_name, ".", nested_proto->name());
 
     VName v_name = builder_->VNameForDescriptor(nested_proto);
-    AddComments(v_name, lookup_path);
+    AddComments(v_name, *lookup_path);
 
     {
-      ScopedLookup name_num(&lookup_path,
-                            EnumDescriptorProto::kNameFieldNumber);
-      const std::vector<int>& span = location_map_[lookup_path];
+      ScopedLookup name_num(lookup_path, EnumDescriptorProto::kNameFieldNumber);
+      const std::vector<int>& span = location_map_[*lookup_path];
       Location location;
       InitializeLocation(span, &location);
 
@@ -486,15 +478,40 @@ void FileDescriptorWalker::VisitNestedEnumTypes(const std::string& message_name,
   }
 }
 
+void FileDescriptorWalker::VisitMessage(const std::string& message_name,
+                                        const VName* parent,
+                                        const Descriptor* dp,
+                                        std::vector<int>* lookup_path) {
+  VName v_name = VNameForProtoPath(file_name_, *lookup_path);
+  AddComments(v_name, *lookup_path);
+
+  {
+    // Also push kNameFieldNumber for location of declaration
+    ScopedLookup name_num(lookup_path, DescriptorProto::kNameFieldNumber);
+
+    const std::vector<int>& span = location_map_[*lookup_path];
+    Location location;
+    InitializeLocation(span, &location);
+
+    builder_->AddMessageType(parent, v_name, location);
+    AttachMarkedSource(v_name, GenerateMarkedSourceForDescriptor(dp));
+  }
+
+  VisitNestedTypes(message_name, &v_name, dp, lookup_path);
+  VisitNestedEnumTypes(message_name, &v_name, dp, lookup_path);
+  VisitOneofs(message_name, v_name, dp, lookup_path);
+  VisitFields(message_name, v_name, dp, lookup_path);
+}
+
 void FileDescriptorWalker::VisitNestedTypes(const std::string& message_name,
                                             const VName* message,
                                             const Descriptor* dp,
-                                            std::vector<int> lookup_path) {
-  ScopedLookup nested_type_num(&lookup_path,
+                                            std::vector<int>* lookup_path) {
+  ScopedLookup nested_type_num(lookup_path,
                                DescriptorProto::kNestedTypeFieldNumber);
 
   for (int i = 0; i < dp->nested_type_count(); i++) {
-    ScopedLookup nested_index(&lookup_path, i);
+    ScopedLookup nested_index(lookup_path, i);
     const Descriptor* nested_proto = dp->nested_type(i);
 
     // The proto compiler synthesizes types to represent map entries. For
@@ -505,51 +522,31 @@ void FileDescriptorWalker::VisitNestedTypes(const std::string& message_name,
       continue;
     }
 
-    std::string vname = absl::StrCat(message_name, ".", nested_proto->name());
-
-    VName v_name = VNameForProtoPath(file_name_, lookup_path);
-    AddComments(v_name, lookup_path);
-
-    {
-      // Also push kNameFieldNumber for location of declaration
-      ScopedLookup name_num(&lookup_path, DescriptorProto::kNameFieldNumber);
-
-      const std::vector<int>& span = location_map_[lookup_path];
-      Location location;
-      InitializeLocation(span, &location);
-
-      builder_->AddMessageType(message, v_name, location);
-      AttachMarkedSource(v_name,
-                         GenerateMarkedSourceForDescriptor(nested_proto));
-    }
-
-    // Need to visit nested enum and message types first!
-    VisitNestedTypes(vname, &v_name, nested_proto, lookup_path);
-    VisitNestedEnumTypes(vname, &v_name, nested_proto, lookup_path);
-    VisitOneofs(vname, v_name, nested_proto, lookup_path);
+    VisitMessage(absl::StrCat(message_name, ".", nested_proto->name()),
+                 message, nested_proto, lookup_path);
   }
 }
 
 void FileDescriptorWalker::VisitOneofs(const std::string& message_name,
                                        const VName& message,
                                        const Descriptor* dp,
-                                       std::vector<int> lookup_path) {
-  ScopedLookup nested_type_num(&lookup_path,
+                                       std::vector<int>* lookup_path) {
+  ScopedLookup nested_type_num(lookup_path,
                                DescriptorProto::kOneofDeclFieldNumber);
 
   for (int i = 0; i < dp->oneof_decl_count(); i++) {
-    ScopedLookup nested_index(&lookup_path, i);
+    ScopedLookup nested_index(lookup_path, i);
     const OneofDescriptor* oneof = dp->oneof_decl(i);
     std::string vname = absl::StrCat(message_name, ".", oneof->name());
 
     VName v_name = builder_->VNameForDescriptor(oneof);
-    AddComments(v_name, lookup_path);
+    AddComments(v_name, *lookup_path);
 
     {
       // TODO: verify that this is correct for oneofs
-      ScopedLookup name_num(&lookup_path, DescriptorProto::kNameFieldNumber);
+      ScopedLookup name_num(lookup_path, DescriptorProto::kNameFieldNumber);
 
-      const std::vector<int>& span = location_map_[lookup_path];
+      const std::vector<int>& span = location_map_[*lookup_path];
       Location location;
       InitializeLocation(span, &location);
 
@@ -577,23 +574,7 @@ void FileDescriptorWalker::VisitMessagesAndEnums(const std::string* ns_name,
       vname = absl::StrCat(*ns_name, ".", vname);
     }
 
-    VName v_name = VNameForProtoPath(file_name_, lookup_path);
-    AddComments(v_name, lookup_path);
-
-    {
-      ScopedLookup name_num(&lookup_path, DescriptorProto::kNameFieldNumber);
-      const std::vector<int>& span = location_map_[lookup_path];
-      Location location;
-      InitializeLocation(span, &location);
-
-      builder_->AddMessageType(ns, v_name, location);
-      AttachMarkedSource(v_name, GenerateMarkedSourceForDescriptor(dp));
-    }
-
-    // Visit nested types first and fields later for easy type resolution
-    VisitNestedTypes(vname, &v_name, dp, lookup_path);
-    VisitNestedEnumTypes(vname, &v_name, dp, lookup_path);
-    VisitOneofs(vname, v_name, dp, lookup_path);
+    VisitMessage(vname, ns, dp, &lookup_path);
   }
 
   // Add top-level ENUM bindings
@@ -622,26 +603,26 @@ void FileDescriptorWalker::VisitMessagesAndEnums(const std::string* ns_name,
     }
 
     // Visit enum values and add kythe bindings for them
-    VisitEnumValues(dp, &v_name, lookup_path);
+    VisitEnumValues(dp, &v_name, &lookup_path);
   }
 }
 
 void FileDescriptorWalker::VisitEnumValues(const EnumDescriptor* dp,
                                            const VName* enum_node,
-                                           std::vector<int> lookup_path) {
-  ScopedLookup value_num(&lookup_path, EnumDescriptorProto::kValueFieldNumber);
+                                           std::vector<int>* lookup_path) {
+  ScopedLookup value_num(lookup_path, EnumDescriptorProto::kValueFieldNumber);
 
   for (int j = 0; j < dp->value_count(); j++) {
     const EnumValueDescriptor* val_dp = dp->value(j);
 
-    ScopedLookup value_index(&lookup_path, j);
+    ScopedLookup value_index(lookup_path, j);
     VName v_name = builder_->VNameForDescriptor(val_dp);
-    AddComments(v_name, lookup_path);
+    AddComments(v_name, *lookup_path);
 
-    ScopedLookup name_num(&lookup_path,
+    ScopedLookup name_num(lookup_path,
                           EnumValueDescriptorProto::kNameFieldNumber);
     Location value_location;
-    InitializeLocation(location_map_[lookup_path], &value_location);
+    InitializeLocation(location_map_[*lookup_path], &value_location);
     std::string value_vname = dp->full_name() + "." + val_dp->name();
 
     builder_->AddValueToEnum(*enum_node, v_name, value_location);
@@ -649,47 +630,23 @@ void FileDescriptorWalker::VisitEnumValues(const EnumDescriptor* dp,
   }
 }
 
-void FileDescriptorWalker::VisitAllFields(const std::string* ns_name,
-                                          const VName* ns) {
+void FileDescriptorWalker::VisitExtensions(const std::string* ns_name,
+                                           const VName* ns) {
   std::vector<int> lookup_path;
-  {
-    ScopedLookup message_num(&lookup_path,
-                             FileDescriptorProto::kMessageTypeFieldNumber);
-
-    // For each top-level message in the file, add the field bindings
-    for (int i = 0; i < file_descriptor_->message_type_count(); i++) {
-      const Descriptor* dp = file_descriptor_->message_type(i);
-      std::string vname = dp->name();
-      if (ns_name != nullptr) {
-        vname = *ns_name + "." + vname;
-      }
-
-      ScopedLookup message_index(&lookup_path, i);
-
-      // Visit fields within the message
-      VisitFields(vname, dp, lookup_path);
-
-      // Visit fields in nested mesages
-      VisitNestedFields(vname, dp, lookup_path);
-    }
-  }
-
-  {
-    ScopedLookup extension_num(&lookup_path,
-                               FileDescriptorProto::kExtensionFieldNumber);
+  ScopedLookup extension_num(&lookup_path,
+                             FileDescriptorProto::kExtensionFieldNumber);
 
-    // For each top-level extension in the file, add the field bindings
-    for (int i = 0; i < file_descriptor_->extension_count(); i++) {
-      ScopedLookup extension_index(&lookup_path, i);
-      VisitExtension(ns_name, ns, file_descriptor_->extension(i), lookup_path);
-    }
+  // For each top-level extension in the file, add the field bindings
+  for (int i = 0; i < file_descriptor_->extension_count(); i++) {
+    ScopedLookup extension_index(&lookup_path, i);
+    VisitExtension(ns_name, ns, file_descriptor_->extension(i), &lookup_path);
   }
 }
 
 void FileDescriptorWalker::VisitExtension(const std::string* parent_name,
                                           const VName* parent,
                                           const FieldDescriptor* field,
-                                          std::vector<int> lookup_path) {
+                                          std::vector<int>* lookup_path) {
   std::string message_name = field->containing_type()->full_name();
   VName message = builder_->VNameForDescriptor(field->containing_type());
   {
@@ -703,9 +660,9 @@ void FileDescriptorWalker::VisitExtension(const std::string* parent_name,
     // definition.  Each of "b" and "c" will generate this reference
     // which can result in duplicate references if more than one
     // field is declared in a single extend block.
-    ScopedLookup extendee_num(&lookup_path,
+    ScopedLookup extendee_num(lookup_path,
                               FieldDescriptorProto::kExtendeeFieldNumber);
-    const std::vector<int>& extendee_span = location_map_[lookup_path];
+    const std::vector<int>& extendee_span = location_map_[*lookup_path];
     Location extendee_location;
     InitializeLocation(extendee_span, &extendee_location);
     builder_->AddReference(message, extendee_location);
@@ -714,35 +671,6 @@ void FileDescriptorWalker::VisitExtension(const std::string* parent_name,
   VisitField(parent_name, parent, message_name, message, field, lookup_path);
 }
 
-void FileDescriptorWalker::VisitNestedFields(const std::string& name_prefix,
-                                             const Descriptor* dp,
-                                             std::vector<int> lookup_path) {
-  ScopedLookup nested_num(&lookup_path,
-                          DescriptorProto::kNestedTypeFieldNumber);
-
-  for (int j = 0; j < dp->nested_type_count(); j++) {
-    const Descriptor* nested_dp = dp->nested_type(j);
-    const std::string nested_name_prefix =
-        absl::StrCat(name_prefix, ".", nested_dp->name());
-
-    // The proto compiler synthesizes types to represent map entries. For
-    // example, a "map<string, string> my_map" field would cause a type
-    // "MyMapEntry" to be generated. Because it doesn't actually exist in the
-    // source .proto file, we ignore it.
-    if (nested_dp->options().map_entry()) {
-      continue;
-    }
-
-    ScopedLookup nested_index(&lookup_path, j);
-
-    // Visit fields within the message
-    VisitFields(nested_name_prefix, nested_dp, lookup_path);
-
-    // Visit fields in nested mesages
-    VisitNestedFields(nested_name_prefix, nested_dp, lookup_path);
-  }
-}
-
 void FileDescriptorWalker::AddComments(const VName& v_name,
                                        const std::vector<int>& path) {
   const auto* protoc_location = FindOrNull(path_location_map_, path);
@@ -865,7 +793,7 @@ void FileDescriptorWalker::PopulateCodeGraph() {
   }
 
   VisitMessagesAndEnums(ns_name, ns);
-  VisitAllFields(ns_name, ns);
+  VisitExtensions(ns_name, ns);
   VisitRpcServices(ns_name, ns);
 }
 
@@ -19,13 +19,13 @@
 
 #include <map>
 #include <memory>
-#include <set>
 #include <string>
 #include <vector>
 
 #include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
 #include "glog/logging.h"
+#include "google/protobuf/descriptor.pb.h"
 #include "kythe/cxx/common/file_vname_generator.h"
 #include "kythe/cxx/common/indexing/KytheOutputStream.h"
 #include "kythe/cxx/common/kythe_uri.h"
@@ -65,13 +65,16 @@ struct PartialLocation {
 // Mainly just a place to keep track of state between related methods.
 class FileDescriptorWalker {
  public:
+  // `file_proto` is the FileDescriptorProto `file_descriptor` was built from,
+  // including its source code info.
   FileDescriptorWalker(const google::protobuf::FileDescriptor* file_descriptor,
-                       const google::protobuf::SourceCodeInfo& source_code_info,
+                       const google::protobuf::FileDescriptorProto& file_proto,
                        const proto::VName& file_name,
                        const std::string& content, ProtoGraphBuilder* builder,
                        ProtoAnalyzer* analyzer)
       : file_descriptor_(file_descriptor),
-        source_code_info_(&source_code_info),
+        file_proto_(&file_proto),
+        source_code_info_(&file_proto.source_code_info()),
         file_name_(file_name),
         content_(content),
         line_index_(kythe::UTF8LineIndex(content_)),
@@ -93,7 +96,8 @@ class FileDescriptorWalker {
 
   // Walks through all of the imports in the descriptor and adds them to the
   // graph. Imports includes all of dependencies, weak dependencies and public
-  // dependencies.
+  // dependencies. Import names are read from the FileDescriptorProto, so that
+  // dependencies that are built lazily are not built just to be named.
   void VisitImports();
 
   // Walks through the fields and declared extensions of the input
@@ -105,10 +109,11 @@ class FileDescriptorWalker {
   // We look for the location of typename (Foo) and save that in Kythe as
   // reference location. We look for the location of the name (bar) and save in
   // Kythe as a declaration.
+  // `message` is the VName of the message.
   // `lookup_path` is expected to point to the parent message (all of it).
-  void VisitFields(const std::string& message_name,
+  void VisitFields(const std::string& message_name, const proto::VName& message,
                    const google::protobuf::Descriptor* dp,
-                   std::vector<int> lookup_path);
+                   std::vector<int>* lookup_path);
 
   // Processes the declaration of an individual field.
   // `parent_name`/`parent` refer to the context this field is declared in
@@ -120,7 +125,7 @@ class FileDescriptorWalker {
   void VisitField(const std::string* parent_name, const proto::VName* parent,
                   const std::string& message_name, const proto::VName& message,
                   const google::protobuf::FieldDescriptor* field,
-                  std::vector<int> lookup_path);
+                  std::vector<int>* lookup_path);
 
   // Processes the declaration of an extended field, and adds a reference
   // to the message being extended (in the "extend X {" line).
@@ -131,7 +136,7 @@ class FileDescriptorWalker {
   void VisitExtension(const std::string* parent_name,
                       const proto::VName* parent,
                       const google::protobuf::FieldDescriptor* field,
-                      std::vector<int> lookup_path);
+                      std::vector<int>* lookup_path);
 
   // Visits all the nested message types in the given DescriptorProto.
   // The nested messages are added to the codegraph.
@@ -139,7 +144,17 @@ class FileDescriptorWalker {
   void VisitNestedEnumTypes(const std::string& message_name,
                             const proto::VName* message,
                             const google::protobuf::Descriptor* dp,
-                            std::vector<int> lookup_path);
+                            std::vector<int>* lookup_path);
+
+  // Visits a message declaration along with everything declared inside it:
+  // nested messages and enums, oneofs, fields and extensions. `parent` is the
+  // context it is declared in (null for top-level messages in a package-less
+  // file).
+  // `lookup_path` must point to the given DescriptorProto.
+  void VisitMessage(const std::string& message_name,
+                    const proto::VName* parent,
+                    const google::protobuf::Descriptor* dp,
+                    std::vector<int>* lookup_path);
 
   // Visits all the nested message types in the given DescriptorProto.
   // The nested messages are added to the codegraph.
@@ -148,7 +163,7 @@ class FileDescriptorWalker {
   void VisitNestedTypes(const std::string& message_name,
                         const proto::VName* message,
                         const google::protobuf::Descriptor* dp,
-                        std::vector<int> lookup_path);
+                        std::vector<int>* lookup_path);
 
   // Visits all the oneofs within a message and adds them to the codegraph.
   // `lookup_path` must point to the given DescriptorProto.
@@ -156,11 +171,11 @@ class FileDescriptorWalker {
   // modify the lookup path, it is left in its original state after we return.
   void VisitOneofs(const std::string& message_name, const proto::VName& message,
                    const google::protobuf::Descriptor* dp,
-                   std::vector<int> lookup_path);
+                   std::vector<int>* lookup_path);
 
   // Visits all the messages and enums within a namespace. All messages and
   // enums, along with their associated fields, oneofs, and values, are added
-  // to the graph.
+  // to the graph in a single pass.
   void VisitMessagesAndEnums(const std::string* ns_name,
                              const proto::VName* ns);
 
@@ -168,12 +183,10 @@ class FileDescriptorWalker {
   // Kythe nodes and edges.
   // `lookup_path` must point to the enum.
   void VisitEnumValues(const google::protobuf::EnumDescriptor* dp,
-                       const proto::VName* e, std::vector<int> lookup_path);
+                       const proto::VName* e, std::vector<int>* lookup_path);
 
-  // Method to add declarations and references for all fields.
-  // We do this after all messages and enums (both top-level and nested)
-  // are added to Kythe.
-  void VisitAllFields(const std::string* ns_name, const proto::VName* ns);
+  // Visits the extensions declared at the top level of the file.
+  void VisitExtensions(const std::string* ns_name, const proto::VName* ns);
 
   // Visit stubby services and input/output methods.
   void VisitRpcServices(const std::string* ns_name, const proto::VName* ns);
@@ -215,9 +228,11 @@ class FileDescriptorWalker {
                           const absl::optional<MarkedSource>& code);
 
   const google::protobuf::FileDescriptor* file_descriptor_;
+  const google::protobuf::FileDescriptorProto* file_proto_;
   const google::protobuf::SourceCodeInfo* source_code_info_;
   const proto::VName file_name_;
-  const std::string content_;
+  // The text of the file being walked; owned by the caller.
+  const absl::string_view content_;
   const kythe::UTF8LineIndex line_index_;
   ProtoGraphBuilder* builder_;
   URI uri_;
@@ -225,24 +240,10 @@ class FileDescriptorWalker {
   std::map<std::vector<int>, google::protobuf::SourceCodeInfo::Location>
       path_location_map_;
 
-  // Set of messages for which their fields are already visited.
-  // There are two functions from which 'VisitFields' gets called;
-  // 'VisitAllFields' and 'VisitNestedTypes'. This causes analyzer to create
-  // duplicate entries for some nodes. This set helps us avoid processing
-  // fields more than once.
-  std::set<std::string> visited_messages_;
-
   // Adds leading and trailing comments for the element specified by ticket and
   // path. `v_name` is the name of the element in question; `path` is used
   // to look up the SourceCodeInfo::Location and the retrieve comment locations.
   void AddComments(const proto::VName& v_name, const std::vector<int>& path);
-
-  // This recursively visits nested fields for VisitAllFields, with the current
-  // parent scope specified by name_prefix, message-descriptor 'dp' and
-  // lookup_path for source information lookup.
-  void VisitNestedFields(const std::string& name_prefix,
-                         const google::protobuf::Descriptor* dp,
-                         std::vector<int> lookup_path);
 };
 
 }  // namespace lang_proto
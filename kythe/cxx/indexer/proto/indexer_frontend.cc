@@ -16,23 +16,287 @@
 
 #include "kythe/cxx/indexer/proto/indexer_frontend.h"
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
 #include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/strip.h"
+#include "absl/types/optional.h"
+#include "glog/logging.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/descriptor_database.h"
 #include "kythe/cxx/common/file_vname_generator.h"
 #include "kythe/cxx/common/indexing/KytheGraphRecorder.h"
 #include "kythe/cxx/common/path_utils.h"
+#include "kythe/cxx/indexer/proto/buffered_output.h"
+#include "kythe/cxx/indexer/proto/parse_cache.h"
+#include "kythe/cxx/indexer/proto/path_substitution_cache.h"
 #include "kythe/cxx/indexer/proto/proto_analyzer.h"
 #include "kythe/cxx/indexer/proto/search_path.h"
+#include "kythe/cxx/indexer/proto/source_info_check.h"
 #include "kythe/cxx/indexer/proto/source_tree.h"
+#include "kythe/cxx/indexer/proto/well_known_types.h"
 #include "kythe/proto/analysis.pb.h"
 
 namespace kythe {
+namespace {
+
+constexpr absl::string_view kDescriptorSetInArg = "--descriptor_set_in=";
+
+// The precompiled descriptors embedded in a compilation unit through
+// --descriptor_set_in.
+struct DescriptorSets {
+  // Descriptors that match their source, by the name they were compiled as.
+  google::protobuf::SimpleDescriptorDatabase db;
+  // The names of all files in `db`.
+  absl::flat_hash_set<std::string> file_names;
+};
+
+// Loads the descriptor sets named by any --descriptor_set_in arguments in
+// `args` from `files`. Only descriptors whose source info matches their
+// source in `files`, found through `path_substitutions`, are used; the rest
+// are parsed from source instead. Descriptor sets don't record what they were
+// compiled from, so this match is all that ties a descriptor to the unit's
+// source: SourceInfoMatches() catches edits that move or change declarations,
+// but we trust the build for the rest, such as changes to options.
+// Returns an empty string if OK; otherwise, an error description.
+std::string LoadDescriptorSets(
+    const std::vector<std::string>& args,
+    const std::vector<std::pair<std::string, std::string>>& path_substitutions,
+    const std::vector<proto::FileData>& files, DescriptorSets* sets) {
+  PathSubstitutionCache substitution_cache;
+  PreloadedProtoFileTree file_reader(&path_substitutions, &substitution_cache);
+  for (const auto& file_data : files) {
+    file_reader.AddFileView(file_data.info().path(), file_data.content());
+  }
+  for (const std::string& arg : args) {
+    absl::string_view set_paths = arg;
+    if (!absl::ConsumePrefix(&set_paths, kDescriptorSetInArg)) {
+      continue;
+    }
+    for (absl::string_view set_path :
+         absl::StrSplit(set_paths, ':', absl::SkipEmpty())) {
+      auto file = std::find_if(files.begin(), files.end(),
+                               [&](const proto::FileData& file_data) {
+                                 return file_data.info().path() == set_path;
+                               });
+      if (file == files.end()) {
+        return absl::StrCat("\n descriptor set ", set_path,
+                            " not in FileData.");
+      }
+      google::protobuf::FileDescriptorSet set;
+      if (!set.ParseFromString(file->content())) {
+        return absl::StrCat("\n descriptor set ", set_path,
+                            " could not be parsed.");
+      }
+      for (const auto& file_proto : set.file()) {
+        if (!file_proto.has_source_code_info() ||
+            sets->file_names.contains(file_proto.name())) {
+          continue;
+        }
+        std::string source;
+        if (!file_reader.Read(file_proto.name(), &source)) {
+          LOG(WARNING) << "No source for precompiled descriptor "
+                       << file_proto.name();
+          continue;
+        }
+        if (!SourceInfoMatches(file_proto, source)) {
+          LOG(WARNING) << "Precompiled descriptor " << file_proto.name()
+                       << " in " << set_path
+                       << " does not match its source; parsing it instead";
+          continue;
+        }
+        sets->db.Add(file_proto);
+        sets->file_names.insert(file_proto.name());
+      }
+    }
+  }
+  return "";
+}
+
+// Holds everything needed to index the source files of a compilation unit.
+// Instances are not thread-safe, so parallel indexing uses one per thread.
+class SourceFileIndexer {
+ public:
+  SourceFileIndexer(
+      const proto::CompilationUnit& unit,
+      const std::vector<std::pair<std::string, std::string>>&
+          path_substitutions,
+      const std::vector<proto::FileData>& files, DescriptorSets* sets,
+      const IndexerOptions& options, KytheOutputStream* output)
+      : sets_(sets),
+        recorder_(output),
+        file_reader_(&path_substitutions, &file_substitution_cache_),
+        source_tree_db_(&file_reader_),
+        parse_cache_db_(
+            options.parse_cache_dir,
+            [this](const std::string& filename) { return Digest(filename); },
+            &source_tree_db_),
+        well_known_types_db_(
+            [this](const std::string& filename) { return Digest(filename); },
+            &parse_cache_db_),
+        descriptor_db_(&sets->db, &well_known_types_db_),
+        analyzer_(&unit, &descriptor_db_, &file_vnames_, &recorder_,
+                  &file_substitution_cache_) {
+    analyzer_.set_lazily_build_dependencies(options.lazily_build_dependencies);
+    for (const auto& file_data : files) {
+      file_reader_.AddFileView(file_data.info().path(), file_data.content());
+      if (!file_data.info().digest().empty()) {
+        file_digests_.emplace(file_data.info().path(),
+                              file_data.info().digest());
+      }
+    }
+    // Resolve each precompiled file to its source the way an import would,
+    // recording the mapping the analyzer uses to find VNames for it.
+    for (const std::string& file_name : sets_->file_names) {
+      file_reader_.Resolve(file_name);
+    }
+  }
+
+  // disallow copy and assign
+  SourceFileIndexer(const SourceFileIndexer&) = delete;
+  void operator=(const SourceFileIndexer&) = delete;
+
+  // Indexes the source file at `file_path`. Returns an empty string if OK;
+  // otherwise, an error description.
+  std::string Index(const std::string& file_path) {
+    if (file_path.empty()) {
+      return "\n empty source_file.";
+    }
+    std::string file_contents;
+    if (!file_reader_.Read(file_path, &file_contents)) {
+      return "\n source_file " + file_path + " not in FileData.";
+    }
+    bool analyzed;
+    absl::optional<std::string> precompiled_name = PrecompiledName(file_path);
+    if (precompiled_name.has_value()) {
+      // Analyze under the precompiled name so that the descriptor is taken
+      // from the descriptor set rather than parsed.
+      analyzed = analyzer_.AnalyzeFile(
+          *precompiled_name, analyzer_.VNameFromRelPath(*precompiled_name),
+          file_contents);
+    } else {
+      analyzed = analyzer_.Parse(file_path, file_contents);
+    }
+    if (!analyzed) {
+      return "\n Analyzer failed on " + file_path;
+    }
+    return "";
+  }
+
+ private:
+  // Returns the digest of the file an import of `filename` resolves to, or an
+  // empty string if there is no such file or it has no digest.
+  std::string Digest(const std::string& filename) {
+    absl::optional<std::string> full_path = file_reader_.Resolve(filename);
+    if (!full_path.has_value()) {
+      return "";
+    }
+    auto found = file_digests_.find(*full_path);
+    return found != file_digests_.end() ? found->second : "";
+  }
+
+  // Returns the name under which the source file at `file_path` was
+  // precompiled into one of the descriptor sets, if any.
+  absl::optional<std::string> PrecompiledName(const std::string& file_path) {
+    if (sets_->file_names.empty()) {
+      return absl::nullopt;
+    }
+    absl::optional<std::string> name =
+        file_reader_.search_path().RelativePath(file_path);
+    if (!name.has_value() || !sets_->file_names.contains(*name)) {
+      return absl::nullopt;
+    }
+    // Only use the precompiled descriptor if its name resolves back to this
+    // file, so that the analyzer attributes it to the right VName.
+    const std::string* full_path =
+        file_substitution_cache_.FindFullPath(*name);
+    if (full_path == nullptr || *full_path != file_path) {
+      return absl::nullopt;
+    }
+    return name;
+  }
+
+  DescriptorSets* sets_;
+  FileVNameGenerator file_vnames_;
+  KytheGraphRecorder recorder_;
+  PathSubstitutionCache file_substitution_cache_;
+  PreloadedProtoFileTree file_reader_;
+  // Full path -> digest, for the files that have one.
+  absl::flat_hash_map<std::string, std::string> file_digests_;
+  google::protobuf::compiler::SourceTreeDescriptorDatabase source_tree_db_;
+  // Parsed source, through the on-disk cache if there is one.
+  CachingDescriptorDatabase parse_cache_db_;
+  // The well-known types compiled into the indexer, if unchanged.
+  WellKnownTypesDatabase well_known_types_db_;
+  // Precompiled descriptors, falling back to parsed source.
+  google::protobuf::MergedDescriptorDatabase descriptor_db_;
+  lang_proto::ProtoAnalyzer analyzer_;
+};
+
+// Indexes the source files of `unit` on up to `options.threads` threads.
+// Each file's output is buffered and written to `output` in source file
+// order, so the result does not depend on scheduling. Returns the
+// concatenated error descriptions, in the same order.
+std::string IndexSourceFilesInParallel(
+    const proto::CompilationUnit& unit,
+    const std::vector<std::pair<std::string, std::string>>& path_substitutions,
+    const std::vector<proto::FileData>& files, DescriptorSets* sets,
+    const IndexerOptions& options, KytheOutputStream* output) {
+  struct Result {
+    // Whether the file is a repeat of an earlier source file, which is only
+    // indexed once.
+    bool duplicate = false;
+    std::string errors;
+    std::vector<proto::Entry> entries;
+  };
+  std::vector<Result> results(unit.source_file_size());
+  absl::flat_hash_set<std::string> seen_files;
+  for (int i = 0; i < unit.source_file_size(); ++i) {
+    results[i].duplicate = !unit.source_file(i).empty() &&
+                           !seen_files.insert(unit.source_file(i)).second;
+  }
+
+  std::atomic<int> next_file(0);
+  auto index_files = [&] {
+    BufferedOutputStream buffer;
+    SourceFileIndexer indexer(unit, path_substitutions, files, sets, options,
+                              &buffer);
+    for (int i = next_file++; i < unit.source_file_size(); i = next_file++) {
+      if (results[i].duplicate) {
+        continue;
+      }
+      results[i].errors = indexer.Index(unit.source_file(i));
+      results[i].entries = buffer.TakeEntries();
+    }
+  };
+  std::vector<std::thread> workers;
+  for (int i = 0; i < std::min(options.threads, unit.source_file_size());
+       ++i) {
+    workers.emplace_back(index_files);
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  std::string errors;
+  for (const Result& result : results) {
+    errors += result.errors;
+    EmitEntries(result.entries, output);
+  }
+  return errors;
+}
+
+}  // namespace
 
 std::string IndexProtoCompilationUnit(const proto::CompilationUnit& unit,
                                       const std::vector<proto::FileData>& files,
-                                      KytheOutputStream* output) {
-  FileVNameGenerator file_vnames;
-  KytheGraphRecorder recorder(output);
-
+                                      KytheOutputStream* output,
+                                      const IndexerOptions& options) {
   std::vector<std::string> unprocessed_args;
   std::vector<std::pair<std::string, std::string>> path_substitutions;
   ::kythe::lang_proto::ParsePathSubstitutions(
@@ -41,32 +305,23 @@ std::string IndexProtoCompilationUnit(const proto::CompilationUnit& unit,
     path_substitutions.push_back({"", CleanPath(unit.working_directory())});
   }
 
-  absl::flat_hash_map<std::string, std::string> file_substitution_cache;
-  PreloadedProtoFileTree file_reader(&path_substitutions,
-                                     &file_substitution_cache);
-  google::protobuf::compiler::SourceTreeDescriptorDatabase descriptor_db(
-      &file_reader);
-  for (const auto& file_data : files) {
-    file_reader.AddFile(file_data.info().path(), file_data.content());
-  }
-  lang_proto::ProtoAnalyzer analyzer(&unit, &descriptor_db, &file_vnames,
-                                     &recorder, &file_substitution_cache);
   if (unit.source_file().empty()) {
     return "Error: no source_files in CompilationUnit.";
   }
-  std::string errors;
-  for (const std::string& file_path : unit.source_file()) {
-    if (file_path.empty()) {
-      errors += "\n empty source_file.";
-      continue;
-    }
-    std::string file_contents;
-    if (!file_reader.Read(file_path, &file_contents)) {
-      errors += "\n source_file " + file_path + " not in FileData.";
-      continue;
-    }
-    if (!analyzer.Parse(file_path, file_contents)) {
-      errors += "\n Analyzer failed on " + file_path;
+  DescriptorSets descriptor_sets;
+  std::string errors = LoadDescriptorSets(unprocessed_args, path_substitutions,
+                                          files, &descriptor_sets);
+  if (!errors.empty()) {
+    return "Errors during indexing:" + errors;
+  }
+  if (options.threads > 1 && unit.source_file_size() > 1) {
+    errors = IndexSourceFilesInParallel(unit, path_substitutions, files,
+                                        &descriptor_sets, options, output);
+  } else {
+    SourceFileIndexer indexer(unit, path_substitutions, files,
+                              &descriptor_sets, options, output);
+    for (const std::string& file_path : unit.source_file()) {
+      errors += indexer.Index(file_path);
     }
   }
   if (!errors.empty()) {
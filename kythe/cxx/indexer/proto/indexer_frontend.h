@@ -28,12 +28,29 @@ class CompilationUnit;
 class FileData;
 }  // namespace proto
 
+// Options controlling how a compilation unit is indexed.
+struct IndexerOptions {
+  // The number of threads used to index the source files of a unit. Output
+  // is the same regardless of this setting.
+  int threads = 1;
+
+  // Build the dependencies of each indexed file only as their symbols are
+  // referenced. See ProtoAnalyzer::set_lazily_build_dependencies().
+  bool lazily_build_dependencies = false;
+
+  // A directory, shared between indexer processes, in which parsed proto
+  // files are cached by content. Empty to parse every file. See
+  // CachingDescriptorDatabase.
+  std::string parse_cache_dir;
+};
+
 // Indexes `unit`, reading file paths and content from `files` and writing
 // Kythe artifacts to `output`. Returns an empty string if OK; otherwise,
 // an error description.
 std::string IndexProtoCompilationUnit(const proto::CompilationUnit& unit,
                                       const std::vector<proto::FileData>& files,
-                                      KytheOutputStream* output);
+                                      KytheOutputStream* output,
+                                      const IndexerOptions& options = {});
 
 }  // namespace kythe
 
@@ -50,6 +50,15 @@ DEFINE_string(o, "-", "Output filename.");
 DEFINE_bool(flush_after_each_entry, false,
             "Flush output after writing each entry.");
 DEFINE_string(index_file, "", ".kzip file containing compilation unit.");
+DEFINE_int32(threads, 1,
+             "Number of threads used to index the source files of each "
+             "compilation unit.");
+DEFINE_bool(lazy_dependencies, false,
+            "Build the dependencies of indexed files only as their symbols "
+            "are referenced. Requires that all inputs are valid protos.");
+DEFINE_string(parse_cache_dir, "",
+              "Directory in which parsed proto files are cached by content. "
+              "May be shared by concurrent indexer processes.");
 
 namespace kythe {
 namespace {
@@ -77,7 +86,7 @@ void DecodeKzipFile(const std::string& path,
       CHECK(content) << "Unable to read file with digest: "
                      << file.info().digest() << ": " << content.status();
       proto::FileData file_data;
-      file_data.set_content(*content);
+      file_data.set_content(std::move(*content));
       file_data.mutable_info()->set_path(file.info().path());
       file_data.mutable_info()->set_digest(file.info().digest());
       virtual_files.push_back(std::move(file_data));
@@ -163,6 +172,10 @@ Examples:
   }
 
   bool had_error = false;
+  IndexerOptions options;
+  options.threads = FLAGS_threads;
+  options.lazily_build_dependencies = FLAGS_lazy_dependencies;
+  options.parse_cache_dir = FLAGS_parse_cache_dir;
 
   {
     google::protobuf::io::FileOutputStream raw_output(write_fd);
@@ -173,7 +186,7 @@ Examples:
       DecodeKzipFile(kzip_file, [&](const proto::CompilationUnit& unit,
                                     std::vector<proto::FileData> file_data) {
         std::string err =
-            IndexProtoCompilationUnit(unit, file_data, &kythe_output);
+            IndexProtoCompilationUnit(unit, file_data, &kythe_output, options);
         if (!err.empty()) {
           had_error = true;
           LOG(ERROR) << "Error: " << err;
@@ -211,7 +224,8 @@ Examples:
             << "Read error for protobuf on STDIN";
       }
 
-      std::string err = IndexProtoCompilationUnit(unit, files, &kythe_output);
+      std::string err =
+          IndexProtoCompilationUnit(unit, files, &kythe_output, options);
       if (!err.empty()) {
         had_error = true;
         LOG(ERROR) << "Error: " << err;
@@ -0,0 +1,138 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/indexer/proto/parse_cache.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <functional>
+#include <thread>
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "glog/logging.h"
+#include "google/protobuf/stubs/common.h"
+
+namespace kythe {
+namespace {
+
+// The longest file name most file systems accept.
+constexpr size_t kMaxEntryNameLength = 255;
+
+// Escapes `filename` so that it can be used as a single path component.
+// Characters other than alphanumerics, '.', '_' and '-' are written as %XX.
+std::string EscapeFileName(absl::string_view filename) {
+  std::string escaped;
+  for (char c : filename) {
+    if (absl::ascii_isalnum(c) || c == '.' || c == '_' || c == '-') {
+      escaped.push_back(c);
+    } else {
+      absl::StrAppend(&escaped, "%",
+                      absl::Hex(static_cast<unsigned char>(c),
+                                absl::kZeroPad2));
+    }
+  }
+  return escaped;
+}
+
+// Reads the whole file at `path` into `contents`.
+bool ReadFile(const std::string& path, std::string* contents) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+  char buf[4096];
+  ssize_t amount_read;
+  while ((amount_read = ::read(fd, buf, sizeof buf)) > 0) {
+    contents->append(buf, amount_read);
+  }
+  ::close(fd);
+  return amount_read == 0;
+}
+
+// Writes `contents` to `path` by way of a temporary file in the same
+// directory, so that readers only ever see complete entries.
+bool WriteFileAtomically(const std::string& path,
+                         const std::string& contents) {
+  std::string temp_path =
+      absl::StrCat(path, ".tmp.", ::getpid(), ".",
+                   std::hash<std::thread::id>()(std::this_thread::get_id()));
+  int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) {
+    return false;
+  }
+  absl::string_view remaining = contents;
+  while (!remaining.empty()) {
+    ssize_t amount_written = ::write(fd, remaining.data(), remaining.size());
+    if (amount_written <= 0) {
+      break;
+    }
+    remaining.remove_prefix(amount_written);
+  }
+  if (::close(fd) != 0 || !remaining.empty() ||
+      std::rename(temp_path.c_str(), path.c_str()) != 0) {
+    ::unlink(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+std::string CachingDescriptorDatabase::EntryName(const std::string& digest,
+                                                 const std::string& filename) {
+  std::string name = absl::StrCat(digest, "-", GOOGLE_PROTOBUF_VERSION, "-",
+                                  EscapeFileName(filename), ".pb");
+  if (name.size() > kMaxEntryNameLength) {
+    return "";
+  }
+  return name;
+}
+
+bool CachingDescriptorDatabase::FindFileByName(
+    const std::string& filename,
+    google::protobuf::FileDescriptorProto* output) {
+  if (cache_dir_.empty()) {
+    return source_db_->FindFileByName(filename, output);
+  }
+  std::string digest = digest_lookup_(filename);
+  std::string entry_name = digest.empty() ? "" : EntryName(digest, filename);
+  if (entry_name.empty()) {
+    return source_db_->FindFileByName(filename, output);
+  }
+  std::string entry_path = absl::StrCat(cache_dir_, "/", entry_name);
+
+  std::string serialized;
+  if (ReadFile(entry_path, &serialized)) {
+    if (output->ParseFromString(serialized) && output->name() == filename) {
+      return true;
+    }
+    LOG(WARNING) << "Ignoring corrupt parse cache entry " << entry_path;
+    output->Clear();
+  }
+
+  if (!source_db_->FindFileByName(filename, output)) {
+    return false;
+  }
+  if (!WriteFileAtomically(entry_path, output->SerializeAsString())) {
+    LOG(WARNING) << "Unable to write parse cache entry " << entry_path;
+  }
+  return true;
+}
+
+}  // namespace kythe
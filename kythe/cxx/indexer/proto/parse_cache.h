@@ -0,0 +1,88 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KYTHE_CXX_INDEXER_PROTO_PARSE_CACHE_H_
+#define KYTHE_CXX_INDEXER_PROTO_PARSE_CACHE_H_
+
+#include <functional>
+#include <string>
+#include <utility>
+
+#include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/descriptor_database.h"
+
+namespace kythe {
+
+// A DescriptorDatabase that keeps the FileDescriptorProtos (with their
+// SourceCodeInfo) produced by another database, usually one that parses
+// source text, in a directory shared between processes. Entries are keyed by
+// the digest of the file's contents, the name it was looked up as, and the
+// version of protobuf that parsed it, so a proto imported by many
+// compilation units is parsed only once per host.
+//
+// Entries are written to a temporary file and renamed into place, so any
+// number of processes may use the same directory concurrently. A missing,
+// unreadable or corrupt entry only causes the file to be parsed again.
+class CachingDescriptorDatabase : public google::protobuf::DescriptorDatabase {
+ public:
+  // Returns the digest of the contents of the file `filename` resolves to,
+  // or an empty string if it is unknown. Files without a digest are not
+  // cached.
+  using DigestLookup = std::function<std::string(const std::string& filename)>;
+
+  // Serves files from `cache_dir`, falling back to `source_db` (which must
+  // outlive this database). An empty `cache_dir` disables the cache.
+  CachingDescriptorDatabase(std::string cache_dir, DigestLookup digest_lookup,
+                            google::protobuf::DescriptorDatabase* source_db)
+      : cache_dir_(std::move(cache_dir)),
+        digest_lookup_(std::move(digest_lookup)),
+        source_db_(source_db) {}
+
+  // disallow copy and assign
+  CachingDescriptorDatabase(const CachingDescriptorDatabase&) = delete;
+  void operator=(const CachingDescriptorDatabase&) = delete;
+
+  bool FindFileByName(const std::string& filename,
+                      google::protobuf::FileDescriptorProto* output) override;
+
+  // Like SourceTreeDescriptorDatabase, symbols can't be searched for without
+  // knowing which file defines them.
+  bool FindFileContainingSymbol(
+      const std::string& symbol_name,
+      google::protobuf::FileDescriptorProto* output) override {
+    return false;
+  }
+  bool FindFileContainingExtension(
+      const std::string& containing_type, int field_number,
+      google::protobuf::FileDescriptorProto* output) override {
+    return false;
+  }
+
+  // Returns the name of the cache entry for the file looked up as `filename`
+  // with contents `digest`, relative to the cache directory, or an empty
+  // string if the name would be too long to store.
+  static std::string EntryName(const std::string& digest,
+                               const std::string& filename);
+
+ private:
+  const std::string cache_dir_;
+  const DigestLookup digest_lookup_;
+  google::protobuf::DescriptorDatabase* source_db_;
+};
+
+}  // namespace kythe
+
+#endif  // KYTHE_CXX_INDEXER_PROTO_PARSE_CACHE_H_
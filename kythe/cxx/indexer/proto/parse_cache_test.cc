@@ -0,0 +1,115 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/indexer/proto/parse_cache.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+
+#include "absl/strings/str_cat.h"
+#include "gtest/gtest.h"
+
+namespace kythe {
+namespace {
+
+using ::google::protobuf::FileDescriptorProto;
+using ::google::protobuf::SimpleDescriptorDatabase;
+
+class CachingDescriptorDatabaseTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    const char* tmpdir = getenv("TEST_TMPDIR");
+    std::string dir_template = absl::StrCat(
+        tmpdir != nullptr ? tmpdir : "/tmp", "/parse_cache.XXXXXX");
+    ASSERT_NE(mkdtemp(&dir_template[0]), nullptr);
+    cache_dir_ = dir_template;
+  }
+
+  // Returns a lookup giving every file the digest `digest`.
+  static CachingDescriptorDatabase::DigestLookup Digest(std::string digest) {
+    return [digest](const std::string&) { return digest; };
+  }
+
+  std::string cache_dir_;
+};
+
+FileDescriptorProto MakeFile(const std::string& name) {
+  FileDescriptorProto file;
+  file.set_name(name);
+  file.set_package("pkg");
+  file.add_message_type()->set_name("Message");
+  file.mutable_source_code_info()->add_location()->add_span(1);
+  return file;
+}
+
+TEST_F(CachingDescriptorDatabaseTest, ServesEntriesWrittenByOtherInstances) {
+  SimpleDescriptorDatabase source_db;
+  ASSERT_TRUE(source_db.Add(MakeFile("foo/bar.proto")));
+  FileDescriptorProto file;
+  {
+    CachingDescriptorDatabase db(cache_dir_, Digest("1234"), &source_db);
+    ASSERT_TRUE(db.FindFileByName("foo/bar.proto", &file));
+  }
+
+  SimpleDescriptorDatabase empty_db;
+  CachingDescriptorDatabase db(cache_dir_, Digest("1234"), &empty_db);
+  FileDescriptorProto cached;
+  ASSERT_TRUE(db.FindFileByName("foo/bar.proto", &cached));
+  EXPECT_EQ(cached.SerializeAsString(), file.SerializeAsString());
+}
+
+TEST_F(CachingDescriptorDatabaseTest, KeysEntriesByDigestAndName) {
+  SimpleDescriptorDatabase source_db;
+  ASSERT_TRUE(source_db.Add(MakeFile("foo/bar.proto")));
+  FileDescriptorProto file;
+  {
+    CachingDescriptorDatabase db(cache_dir_, Digest("1234"), &source_db);
+    ASSERT_TRUE(db.FindFileByName("foo/bar.proto", &file));
+  }
+
+  SimpleDescriptorDatabase empty_db;
+  CachingDescriptorDatabase changed(cache_dir_, Digest("5678"), &empty_db);
+  EXPECT_FALSE(changed.FindFileByName("foo/bar.proto", &file));
+  CachingDescriptorDatabase renamed(cache_dir_, Digest("1234"), &empty_db);
+  EXPECT_FALSE(renamed.FindFileByName("bar.proto", &file));
+}
+
+TEST_F(CachingDescriptorDatabaseTest, SkipsFilesWithoutDigests) {
+  SimpleDescriptorDatabase source_db;
+  ASSERT_TRUE(source_db.Add(MakeFile("foo/bar.proto")));
+  FileDescriptorProto file;
+  {
+    CachingDescriptorDatabase db(cache_dir_, Digest(""), &source_db);
+    ASSERT_TRUE(db.FindFileByName("foo/bar.proto", &file));
+  }
+
+  SimpleDescriptorDatabase empty_db;
+  CachingDescriptorDatabase db(cache_dir_, Digest(""), &empty_db);
+  EXPECT_FALSE(db.FindFileByName("foo/bar.proto", &file));
+}
+
+TEST(CachingDescriptorDatabaseEntryNameTest, EscapesPathSeparators) {
+  std::string name =
+      CachingDescriptorDatabase::EntryName("1234", "foo/bar baz.proto");
+  EXPECT_EQ(name.find('/'), std::string::npos);
+  EXPECT_NE(name.find("foo%2fbar%20baz.proto"), std::string::npos);
+  EXPECT_EQ(CachingDescriptorDatabase::EntryName("1234", std::string(300, 'a')),
+            "");
+}
+
+}  // namespace
+}  // namespace kythe
@@ -0,0 +1,42 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/indexer/proto/path_substitution_cache.h"
+
+namespace kythe {
+
+bool PathSubstitutionCache::Insert(absl::string_view relative_path,
+                                   absl::string_view full_path) {
+  if (!full_paths_.emplace(relative_path, full_path).second) {
+    return false;
+  }
+  relative_paths_.emplace(full_path, relative_path);
+  return true;
+}
+
+const std::string* PathSubstitutionCache::FindFullPath(
+    absl::string_view relative_path) const {
+  auto it = full_paths_.find(relative_path);
+  return it == full_paths_.end() ? nullptr : &it->second;
+}
+
+const std::string* PathSubstitutionCache::FindRelativePath(
+    absl::string_view full_path) const {
+  auto it = relative_paths_.find(full_path);
+  return it == relative_paths_.end() ? nullptr : &it->second;
+}
+
+}  // namespace kythe
@@ -0,0 +1,63 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KYTHE_CXX_INDEXER_PROTO_PATH_SUBSTITUTION_CACHE_H_
+#define KYTHE_CXX_INDEXER_PROTO_PATH_SUBSTITUTION_CACHE_H_
+
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+
+namespace kythe {
+
+// Records the files that have been resolved through path substitutions (see
+// PreloadedProtoFileTree) as pairs of a relative path, such as the argument
+// of an import statement, and the full path of the file it was found at.
+// Both directions can be looked up in constant time.
+class PathSubstitutionCache {
+ public:
+  PathSubstitutionCache() = default;
+
+  // disallow copy and assign
+  PathSubstitutionCache(const PathSubstitutionCache&) = delete;
+  void operator=(const PathSubstitutionCache&) = delete;
+
+  // Records that `relative_path` resolves to `full_path`. Returns false,
+  // leaving the cache unchanged, if `relative_path` was already recorded.
+  // When several relative paths resolve to the same full path, the first one
+  // recorded is the one returned by FindRelativePath().
+  bool Insert(absl::string_view relative_path, absl::string_view full_path);
+
+  // Returns the full path `relative_path` resolves to, or null if it has not
+  // been recorded.
+  const std::string* FindFullPath(absl::string_view relative_path) const;
+
+  // Returns the first relative path recorded as resolving to `full_path`, or
+  // null if there is none.
+  const std::string* FindRelativePath(absl::string_view full_path) const;
+
+ private:
+  // Relative path -> full path.
+  absl::flat_hash_map<std::string, std::string> full_paths_;
+
+  // Full path -> relative path.
+  absl::flat_hash_map<std::string, std::string> relative_paths_;
+};
+
+}  // namespace kythe
+
+#endif  // KYTHE_CXX_INDEXER_PROTO_PATH_SUBSTITUTION_CACHE_H_
@@ -16,7 +16,6 @@
 
 #include "kythe/cxx/indexer/proto/proto_analyzer.h"
 
-#include "absl/container/flat_hash_map.h"
 #include "absl/strings/string_view.h"
 #include "glog/logging.h"
 #include "google/protobuf/stubs/map_util.h"
@@ -26,7 +25,6 @@ namespace kythe {
 namespace lang_proto {
 
 using ::google::protobuf::FileDescriptorProto;
-using ::google::protobuf::FindWithDefault;
 using ::google::protobuf::InsertIfNotPresent;
 using ::kythe::proto::VName;
 
@@ -40,7 +38,7 @@ ProtoAnalyzer::ProtoAnalyzer(
     const proto::CompilationUnit* unit,
     google::protobuf::DescriptorDatabase* descriptor_db,
     FileVNameGenerator* file_vnames, KytheGraphRecorder* recorder,
-    absl::flat_hash_map<std::string, std::string>* path_substitution_cache)
+    PathSubstitutionCache* path_substitution_cache)
     : unit_(unit),
       file_vnames_(file_vnames),
       recorder_(recorder),
@@ -51,6 +49,9 @@ bool ProtoAnalyzer::AnalyzeFile(const std::string& rel_path,
                                 const VName& v_name,
                                 const std::string& content) {
   google::protobuf::DescriptorPool pool(descriptor_db_);
+  if (lazily_build_dependencies_) {
+    pool.InternalSetLazilyBuildDependencies();
+  }
   ProtoGraphBuilder builder(recorder_, [&](const std::string& path) {
     return VNameFromRelPath(path);
   });
@@ -91,8 +92,8 @@ bool ProtoAnalyzer::AnalyzeFile(const std::string& rel_path,
     return false;
   }
 
-  FileDescriptorWalker walker(descriptor, descriptor_proto.source_code_info(),
-                              v_name, content, &builder, this);
+  FileDescriptorWalker walker(descriptor, descriptor_proto, v_name, content,
+                              &builder, this);
   walker.PopulateCodeGraph();
   return true;
 }
@@ -105,9 +106,10 @@ bool ProtoAnalyzer::Parse(const std::string& proto_file,
 
 VName ProtoAnalyzer::VNameFromRelPath(
     const std::string& simplified_path) const {
-  std::string full_path = FindWithDefault(*path_substitution_cache_,
-                                          simplified_path, simplified_path);
-  return VNameFromFullPath(full_path);
+  const std::string* full_path =
+      path_substitution_cache_->FindFullPath(simplified_path);
+  return VNameFromFullPath(full_path != nullptr ? *full_path
+                                                : simplified_path);
 }
 
 VName ProtoAnalyzer::VNameFromFullPath(const std::string& path) const {
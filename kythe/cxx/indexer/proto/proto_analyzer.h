@@ -20,13 +20,13 @@
 #include <memory>
 #include <string>
 
-#include "absl/container/flat_hash_map.h"
 #include "absl/container/node_hash_set.h"
 #include "glog/logging.h"
 #include "google/protobuf/descriptor.h"
 #include "google/protobuf/descriptor_database.h"
 #include "kythe/cxx/common/file_vname_generator.h"
 #include "kythe/cxx/common/kythe_uri.h"
+#include "kythe/cxx/indexer/proto/path_substitution_cache.h"
 #include "kythe/cxx/indexer/proto/proto_graph_builder.h"
 #include "kythe/proto/analysis.pb.h"
 #include "kythe/proto/common.pb.h"
@@ -47,12 +47,20 @@ class ProtoAnalyzer {
       const proto::CompilationUnit* unit,
       google::protobuf::DescriptorDatabase* descriptor_db,
       FileVNameGenerator* file_vnames, KytheGraphRecorder* recorder,
-      absl::flat_hash_map<std::string, std::string>* path_substitution_cache);
+      PathSubstitutionCache* path_substitution_cache);
 
   // disallow copy and assign
   ProtoAnalyzer(const ProtoAnalyzer&) = delete;
   void operator=(const ProtoAnalyzer&) = delete;
 
+  // Sets whether the descriptor pools used for analysis build the files
+  // imported by the file being analyzed only once one of their symbols is
+  // resolved, rather than up front. This skips work for imports that are
+  // never referenced, but requires that all of the inputs are valid.
+  void set_lazily_build_dependencies(bool lazily_build_dependencies) {
+    lazily_build_dependencies_ = lazily_build_dependencies;
+  }
+
   // A wrapper for AnalyzeFile that generates the VName and relativizes
   // the proto file path.
   bool Parse(const std::string& proto_file, const std::string& content);
@@ -86,11 +94,14 @@ class ProtoAnalyzer {
 
   // Maps files to paths which include their prefix directories, the most
   // common being bazel-out/ derivatives.
-  absl::flat_hash_map<std::string, std::string>* path_substitution_cache_;
+  PathSubstitutionCache* path_substitution_cache_;
 
   // Gives us properly linked together descriptors for proto files and their
   // contents.
   google::protobuf::DescriptorDatabase* descriptor_db_;
+
+  // See set_lazily_build_dependencies().
+  bool lazily_build_dependencies_ = false;
 };
 
 }  // namespace lang_proto
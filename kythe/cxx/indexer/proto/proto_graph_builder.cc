@@ -43,7 +43,7 @@ std::string StringifyKind(EdgeKindID kind) {
 }  // anonymous namespace
 
 void ProtoGraphBuilder::SetText(const VName& node_name,
-                                const std::string& content) {
+                                absl::string_view content) {
   VLOG(1) << "Setting text (length = " << content.length()
           << ") for: " << StringifyNode(node_name);
   recorder_->AddProperty(VNameRef(node_name), kythe::PropertyID::kText,
@@ -91,8 +91,9 @@ VName ProtoGraphBuilder::CreateAndAddDocNode(const Location& location,
   // Adjust the text to splice out comment markers, as per
   // http://www.kythe.io/docs/schema/#doc
   AddNode(doc, NodeKindID::kDoc);
-  std::string comment = StripCommentMarkers(current_file_contents_.substr(
-      location.begin, location.end - location.begin));
+  std::string comment = StripCommentMarkers(std::string(
+      current_file_contents_.substr(location.begin,
+                                    location.end - location.begin)));
   recorder_->AddProperty(VNameRef(doc), PropertyID::kText, comment);
   return doc;
 }
@@ -23,6 +23,7 @@
 #include <utility>
 #include <vector>
 
+#include "absl/strings/string_view.h"
 #include "glog/logging.h"
 #include "google/protobuf/io/printer.h"
 #include "google/protobuf/io/zero_copy_stream_impl_lite.h"
@@ -74,8 +75,9 @@ class ProtoGraphBuilder {
                                                    vname_for_rel_path_);
   }
 
-  // Sets the source text for this file.
-  void SetText(const proto::VName& node_name, const std::string& content);
+  // Sets the source text for this file. `content` is not copied and must
+  // outlive any subsequent calls on this builder.
+  void SetText(const proto::VName& node_name, absl::string_view content);
 
   // Records a node with the given VName and kind in the graph.
   void AddNode(const proto::VName& node_name, NodeKindID node_kind);
@@ -158,7 +160,7 @@ class ProtoGraphBuilder {
   std::function<proto::VName(const std::string&)> vname_for_rel_path_;
 
   // The text of the current file being analyzed.
-  std::string current_file_contents_;
+  absl::string_view current_file_contents_;
 };
 
 }  // namespace kythe
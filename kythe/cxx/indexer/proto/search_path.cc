@@ -1,5 +1,8 @@
 #include "search_path.h"
 
+#include <algorithm>
+
+#include "absl/strings/match.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_replace.h"
 #include "absl/strings/str_split.h"
@@ -83,5 +86,92 @@ std::vector<std::string> PathSubstitutionsToArgs(
   return args;
 }
 
+SearchPathIndex::SearchPathIndex(
+    const std::vector<std::pair<std::string, std::string>>& substitutions)
+    : substitutions_(substitutions) {
+  for (size_t i = 0; i < substitutions_.size(); ++i) {
+    std::string dir = substitutions_[i].second;
+    if (!absl::EndsWith(dir, "/")) {
+      dir += "/";
+    }
+    real_dirs_.emplace(std::move(dir), i);
+
+    if (substitutions_[i].first.empty()) {
+      search_dirs_.push_back(i);
+    } else {
+      virtual_dirs_[substitutions_[i].first].push_back(i);
+    }
+  }
+}
+
+absl::optional<std::string> SearchPathIndex::RelativePath(
+    absl::string_view full_path) const {
+  // Every '/' in `full_path` ends a directory that may be the real side of a
+  // substitution. Of those that are, the earliest substitution wins.
+  const size_t kNotFound = substitutions_.size();
+  size_t best = kNotFound;
+  size_t best_dir_size = 0;
+  for (size_t slash = full_path.find('/'); slash != absl::string_view::npos;
+       slash = full_path.find('/', slash + 1)) {
+    auto found = real_dirs_.find(full_path.substr(0, slash + 1));
+    if (found != real_dirs_.end() && found->second < best) {
+      best = found->second;
+      best_dir_size = slash + 1;
+    }
+  }
+  if (best == kNotFound) {
+    return absl::nullopt;
+  }
+  absl::string_view relpath = full_path.substr(best_dir_size);
+  const std::string& virtual_dir = substitutions_[best].first;
+  return virtual_dir.empty() ? std::string(relpath)
+                             : JoinPath(virtual_dir, relpath);
+}
+
+bool SearchPathIndex::VisitRealPaths(
+    absl::string_view filename,
+    absl::FunctionRef<bool(const std::string& real_path,
+                           const std::pair<std::string, std::string>&
+                               substitution)>
+        visit) const {
+  // Collect the applicable substitutions along with the length of the
+  // virtual directory each one replaces. `filename` itself and each of its
+  // parent directories may be a virtual directory.
+  absl::InlinedVector<std::pair<size_t, size_t>, 8> candidates;
+  for (size_t i : search_dirs_) {
+    candidates.emplace_back(i, 0);
+  }
+  for (size_t end = filename.find('/');; end = filename.find('/', end + 1)) {
+    absl::string_view prefix = filename.substr(0, end);
+    auto found = virtual_dirs_.find(prefix);
+    if (found != virtual_dirs_.end()) {
+      for (size_t i : found->second) {
+        candidates.emplace_back(i, prefix.size());
+      }
+    }
+    if (end == absl::string_view::npos) {
+      break;
+    }
+  }
+  std::sort(candidates.begin(), candidates.end());
+
+  for (const auto& candidate : candidates) {
+    const auto& substitution = substitutions_[candidate.first];
+    std::string real_path;
+    if (substitution.first.empty()) {
+      real_path = CleanPath(JoinPath(substitution.second, filename));
+    } else if (candidate.second == filename.size()) {
+      real_path = substitution.second;
+    } else {
+      real_path = CleanPath(
+          absl::StrCat(substitution.second, filename.substr(candidate.second)));
+    }
+    if (visit(real_path, substitution)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 }  // namespace lang_proto
 }  // namespace kythe
@@ -18,8 +18,14 @@
 #define KYTHE_CXX_INDEXER_PROTO_SEARCH_PATH_H_
 
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/inlined_vector.h"
+#include "absl/functional/function_ref.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
 #include "google/protobuf/repeated_field.h"
 
 namespace kythe {
@@ -44,6 +50,55 @@ void ParsePathSubstitutions(
 std::vector<std::string> PathSubstitutionsToArgs(
     const std::vector<std::pair<std::string, std::string>>& substitutions);
 
+// An index over a list of path substitutions, as produced by
+// ParsePathSubstitutions(), for mapping paths between the real and virtual
+// sides of the substitutions without trying each one in turn. Both directions
+// look up each directory prefix of the given path in a map, so the cost
+// depends on the depth of the path rather than on the number of
+// substitutions.
+class SearchPathIndex {
+ public:
+  // Builds an index over `substitutions`, which are (virtual, real) pairs in
+  // the order they were given to the proto compiler.
+  explicit SearchPathIndex(
+      const std::vector<std::pair<std::string, std::string>>& substitutions);
+
+  // Returns the path by which the file at `full_path` would be imported: the
+  // remainder of `full_path` below the real directory of the first
+  // substitution containing it, prefixed with that substitution's virtual
+  // directory. Returns nullopt if no substitution contains `full_path`.
+  absl::optional<std::string> RelativePath(absl::string_view full_path) const;
+
+  // Calls `visit` with the real path that `filename` maps to under each
+  // applicable substitution, in the order the substitutions were given, until
+  // `visit` returns true. A substitution applies if its virtual directory is
+  // empty, equal to `filename`, or a directory containing `filename`.
+  // Returns whether `visit` returned true.
+  bool VisitRealPaths(
+      absl::string_view filename,
+      absl::FunctionRef<bool(const std::string& real_path,
+                             const std::pair<std::string, std::string>&
+                                 substitution)>
+          visit) const;
+
+ private:
+  // The indexed substitutions.
+  std::vector<std::pair<std::string, std::string>> substitutions_;
+
+  // Indices of the substitutions with an empty virtual directory, which apply
+  // to every filename.
+  std::vector<size_t> search_dirs_;
+
+  // Nonempty virtual directory -> indices of the substitutions with that
+  // virtual directory, in order.
+  absl::flat_hash_map<std::string, absl::InlinedVector<size_t, 1>>
+      virtual_dirs_;
+
+  // Real directory (with a trailing '/') -> index of the first substitution
+  // with that real directory.
+  absl::flat_hash_map<std::string, size_t> real_dirs_;
+};
+
 }  // namespace lang_proto
 }  // namespace kythe
 
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/indexer/proto/search_path.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace kythe {
+namespace lang_proto {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::Optional;
+
+using Substitutions = std::vector<std::pair<std::string, std::string>>;
+
+TEST(SearchPathIndexTest, RelativePathUnderSearchPath) {
+  SearchPathIndex index(
+      Substitutions{{"", "bazel-out/genfiles"}, {"", "src"}});
+  EXPECT_THAT(index.RelativePath("src/foo/bar.proto"),
+              Optional(Eq("foo/bar.proto")));
+  EXPECT_THAT(index.RelativePath("bazel-out/genfiles/baz.proto"),
+              Optional(Eq("baz.proto")));
+}
+
+TEST(SearchPathIndexTest, RelativePathAppliesVirtualDirectory) {
+  SearchPathIndex index(
+      Substitutions{{"google/protobuf", "third_party/protobuf/src"}});
+  EXPECT_THAT(index.RelativePath("third_party/protobuf/src/any.proto"),
+              Optional(Eq("google/protobuf/any.proto")));
+}
+
+TEST(SearchPathIndexTest, RelativePathUsesFirstMatchingSubstitution) {
+  SearchPathIndex index(Substitutions{{"", "a/b"}, {"", "a"}, {"x", "a/b"}});
+  EXPECT_THAT(index.RelativePath("a/b/c.proto"), Optional(Eq("c.proto")));
+
+  SearchPathIndex reversed(Substitutions{{"", "a"}, {"", "a/b"}});
+  EXPECT_THAT(reversed.RelativePath("a/b/c.proto"),
+              Optional(Eq("b/c.proto")));
+}
+
+TEST(SearchPathIndexTest, RelativePathMatchesWholeDirectories) {
+  SearchPathIndex index(Substitutions{{"", "src"}});
+  EXPECT_THAT(index.RelativePath("srcs/foo.proto"), Eq(absl::nullopt));
+  EXPECT_THAT(index.RelativePath("foo.proto"), Eq(absl::nullopt));
+}
+
+// Returns the real paths visited for `filename`, in order.
+std::vector<std::string> RealPaths(const SearchPathIndex& index,
+                                   absl::string_view filename) {
+  std::vector<std::string> paths;
+  index.VisitRealPaths(
+      filename, [&](const std::string& path,
+                    const std::pair<std::string, std::string>& substitution) {
+        paths.push_back(path);
+        return false;
+      });
+  return paths;
+}
+
+TEST(SearchPathIndexTest, VisitRealPathsInSubstitutionOrder) {
+  SearchPathIndex index(Substitutions{{"foo", "out/foo"},
+                                      {"", "src"},
+                                      {"foo/bar.proto", "gen/bar.proto"},
+                                      {"foo/bar", "other"},
+                                      {"", "."}});
+  EXPECT_THAT(RealPaths(index, "foo/bar.proto"),
+              ElementsAre("out/foo/bar.proto", "src/foo/bar.proto",
+                          "gen/bar.proto", "foo/bar.proto"));
+}
+
+TEST(SearchPathIndexTest, VisitRealPathsMatchesWholeDirectories) {
+  SearchPathIndex index(Substitutions{{"foo", "out"}, {"foo/bar", "gen"}});
+  EXPECT_THAT(RealPaths(index, "foobar/baz.proto"), ElementsAre());
+  EXPECT_THAT(RealPaths(index, "foo/bar/baz.proto"),
+              ElementsAre("out/bar/baz.proto", "gen/baz.proto"));
+}
+
+TEST(SearchPathIndexTest, VisitRealPathsStopsAtFirstAccepted) {
+  SearchPathIndex index(Substitutions{{"", "a"}, {"", "b"}, {"", "c"}});
+  std::vector<std::string> visited;
+  EXPECT_TRUE(index.VisitRealPaths(
+      "x.proto", [&](const std::string& path,
+                     const std::pair<std::string, std::string>& substitution) {
+        visited.push_back(path);
+        return substitution.second == "b";
+      }));
+  EXPECT_THAT(visited, ElementsAre("a/x.proto", "b/x.proto"));
+}
+
+}  // namespace
+}  // namespace lang_proto
+}  // namespace kythe
@@ -0,0 +1,308 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/indexer/proto/source_info_check.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/strip.h"
+#include "absl/types/optional.h"
+#include "google/protobuf/message.h"
+
+namespace kythe {
+namespace {
+
+using ::google::protobuf::FieldDescriptor;
+using ::google::protobuf::Message;
+using ::google::protobuf::Reflection;
+using ::google::protobuf::RepeatedField;
+
+// Returns the offset of the character at `column` in `line`, or nullopt if
+// none starts there. Columns count bytes, except that tabs advance to the next
+// multiple of 8.
+absl::optional<size_t> ColumnOffset(absl::string_view line, int column) {
+  int current = 0;
+  size_t offset = 0;
+  while (current < column && offset < line.size()) {
+    current = line[offset] == '\t' ? current + 8 - current % 8 : current + 1;
+    ++offset;
+  }
+  if (current != column) {
+    return absl::nullopt;
+  }
+  return offset;
+}
+
+// Returns the offset of `column` on `line` in the source split into `lines`,
+// or nullopt if the source has no such position.
+absl::optional<size_t> SourceOffset(const std::vector<absl::string_view>& lines,
+                                    int line, int column) {
+  if (line < 0 || static_cast<size_t>(line) >= lines.size()) {
+    return absl::nullopt;
+  }
+  absl::optional<size_t> offset = ColumnOffset(lines[line], column);
+  if (!offset.has_value()) {
+    return absl::nullopt;
+  }
+  for (int i = 0; i < line; ++i) {
+    *offset += lines[i].size() + 1;
+  }
+  return offset;
+}
+
+// Returns the text that `span`, a SourceCodeInfo.Location span, covers in the
+// source split into `lines`, or nullopt if it does not lie within one line of
+// the source.
+absl::optional<absl::string_view> SpanText(
+    const std::vector<absl::string_view>& lines,
+    const RepeatedField<int32_t>& span) {
+  if (span.size() != 3 || span[0] < 0 ||
+      static_cast<size_t>(span[0]) >= lines.size()) {
+    return absl::nullopt;
+  }
+  absl::string_view line = lines[span[0]];
+  absl::optional<size_t> begin = ColumnOffset(line, span[1]);
+  absl::optional<size_t> end = ColumnOffset(line, span[2]);
+  if (!begin.has_value() || !end.has_value() || *end < *begin) {
+    return absl::nullopt;
+  }
+  return line.substr(*begin, *end - *begin);
+}
+
+// Returns the last character that `span` covers in the source split into
+// `lines`, or nullopt if it covers none. Unlike SpanText(), `span` may run over
+// several lines.
+absl::optional<char> LastSpanChar(const std::vector<absl::string_view>& lines,
+                                  const RepeatedField<int32_t>& span) {
+  int line = span.size() == 4 ? span[2] : span[0];
+  if (line < 0 || static_cast<size_t>(line) >= lines.size()) {
+    return absl::nullopt;
+  }
+  absl::optional<size_t> end = ColumnOffset(lines[line], span[span.size() - 1]);
+  if (!end.has_value() || *end == 0) {
+    return absl::nullopt;
+  }
+  return lines[line][*end - 1];
+}
+
+// Returns whether `text` holds nothing but whitespace and comments.
+bool IsBlank(absl::string_view text) {
+  while (true) {
+    text = absl::StripLeadingAsciiWhitespace(text);
+    if (text.empty()) {
+      return true;
+    }
+    if (absl::ConsumePrefix(&text, "//")) {
+      size_t end = text.find('\n');
+      text = end == absl::string_view::npos ? "" : text.substr(end);
+    } else if (absl::ConsumePrefix(&text, "/*")) {
+      size_t end = text.find("*/");
+      if (end == absl::string_view::npos) {
+        return false;
+      }
+      text.remove_prefix(end + 2);
+    } else {
+      return false;
+    }
+  }
+}
+
+// Returns whether `span`, the span recorded for the whole file, runs from the
+// first token of `source`, split into `lines`, to its last.
+bool SpansWholeSource(absl::string_view source,
+                      const std::vector<absl::string_view>& lines,
+                      const RepeatedField<int32_t>& span) {
+  absl::optional<size_t> begin = SourceOffset(lines, span[0], span[1]);
+  absl::optional<size_t> end = SourceOffset(
+      lines, span.size() == 4 ? span[2] : span[0], span[span.size() - 1]);
+  return begin.has_value() && end.has_value() && *begin <= *end &&
+         IsBlank(source.substr(0, *begin)) && IsBlank(source.substr(*end));
+}
+
+// Returns whether `text`, a possibly-qualified type name as written in
+// source, can name the fully-qualified type `full_name` (".pkg.Type").
+bool NamesType(absl::string_view text, absl::string_view full_name) {
+  // Map fields refer to their synthesized entry type as "map<K, V>".
+  absl::string_view rest = text;
+  if (absl::ConsumePrefix(&rest, "map") &&
+      absl::StartsWith(absl::StripLeadingAsciiWhitespace(rest), "<")) {
+    return absl::EndsWith(full_name, "Entry");
+  }
+  absl::ConsumePrefix(&text, ".");
+  return !text.empty() && absl::EndsWith(full_name, absl::StrCat(".", text));
+}
+
+// Returns whether `text` is the source of the value of the leaf `field` of
+// `message`. Fields that aren't checked always match.
+bool LeafMatches(const Message& message, const FieldDescriptor& field,
+                 absl::string_view text) {
+  const Reflection& reflection = *message.GetReflection();
+  const std::string& name = field.name();
+  if (name == "name" && field.cpp_type() == FieldDescriptor::CPPTYPE_STRING) {
+    // Group fields are named for their group in lower case.
+    return absl::EqualsIgnoreCase(text, reflection.GetString(message, &field));
+  }
+  if ((name == "type_name" || name == "extendee" || name == "input_type" ||
+       name == "output_type") &&
+      field.cpp_type() == FieldDescriptor::CPPTYPE_STRING) {
+    return NamesType(text, reflection.GetString(message, &field));
+  }
+  if (name == "type" && field.cpp_type() == FieldDescriptor::CPPTYPE_ENUM) {
+    // FieldDescriptorProto.TYPE_INT32 is written "int32", and so on.
+    absl::string_view keyword = reflection.GetEnum(message, &field)->name();
+    absl::ConsumePrefix(&keyword, "TYPE_");
+    return absl::EqualsIgnoreCase(text, keyword);
+  }
+  if (name == "label" && field.cpp_type() == FieldDescriptor::CPPTYPE_ENUM) {
+    // LABEL_REPEATED is written "repeated", and so on. Fields declared without
+    // a label have no span for it.
+    absl::string_view keyword = reflection.GetEnum(message, &field)->name();
+    absl::ConsumePrefix(&keyword, "LABEL_");
+    return absl::EqualsIgnoreCase(text, keyword);
+  }
+  if (name == "number" && field.cpp_type() == FieldDescriptor::CPPTYPE_INT32) {
+    std::string number(text);
+    char* end = nullptr;
+    long value = std::strtol(number.c_str(), &end, 0);
+    return !number.empty() && *end == '\0' &&
+           value == reflection.GetInt32(message, &field);
+  }
+  return true;
+}
+
+// Returns whether the declaration part that `path`, a SourceCodeInfo.Location
+// path, leads to in `file_proto` is written as `text`. Paths to anything
+// that isn't checked always match.
+bool PathMatches(const google::protobuf::FileDescriptorProto& file_proto,
+                 const RepeatedField<int32_t>& path, absl::string_view text) {
+  const Message* message = &file_proto;
+  for (int i = 0; i < path.size(); ++i) {
+    const Reflection& reflection = *message->GetReflection();
+    const FieldDescriptor* field =
+        message->GetDescriptor()->FindFieldByNumber(path[i]);
+    if (field == nullptr) {
+      return true;
+    }
+    bool last = i + 1 == path.size();
+    if (field->cpp_type() != FieldDescriptor::CPPTYPE_MESSAGE) {
+      return !last || field->is_repeated() ||
+             LeafMatches(*message, *field, text);
+    }
+    if (field->is_repeated()) {
+      if (last) {
+        return true;  // The whole list, such as all fields of a message.
+      }
+      int index = path[++i];
+      if (index < 0 || index >= reflection.FieldSize(*message, field)) {
+        return false;
+      }
+      message = &reflection.GetRepeatedMessage(*message, field, index);
+    } else {
+      message = &reflection.GetMessage(*message, field);
+    }
+  }
+  return true;
+}
+
+// Returns the characters that may end the declaration `path` leads to in
+// `file_proto`: the closing brace of a body, or the semicolon of a statement.
+// Returns an empty string if its end isn't checked.
+absl::string_view DeclarationEnds(
+    const google::protobuf::FileDescriptorProto& file_proto,
+    const RepeatedField<int32_t>& path) {
+  const Message* message = &file_proto;
+  for (int i = 0; i < path.size(); ++i) {
+    const Reflection& reflection = *message->GetReflection();
+    const FieldDescriptor* field =
+        message->GetDescriptor()->FindFieldByNumber(path[i]);
+    if (field == nullptr ||
+        field->cpp_type() != FieldDescriptor::CPPTYPE_MESSAGE) {
+      return "";
+    }
+    if (!field->is_repeated()) {
+      message = &reflection.GetMessage(*message, field);
+      continue;
+    }
+    if (i + 1 == path.size()) {
+      // The path to a list of extensions spans an extend block.
+      return field->name() == "extension" ? "}" : "";
+    }
+    int index = path[++i];
+    if (index < 0 || index >= reflection.FieldSize(*message, field)) {
+      return "";
+    }
+    message = &reflection.GetRepeatedMessage(*message, field, index);
+  }
+  const std::string& type = message->GetDescriptor()->full_name();
+  if (type == "google.protobuf.DescriptorProto" ||
+      type == "google.protobuf.EnumDescriptorProto" ||
+      type == "google.protobuf.ServiceDescriptorProto" ||
+      type == "google.protobuf.OneofDescriptorProto") {
+    return "}";
+  }
+  if (type == "google.protobuf.FieldDescriptorProto" ||
+      type == "google.protobuf.EnumValueDescriptorProto" ||
+      type == "google.protobuf.MethodDescriptorProto") {
+    return ";}";  // Groups and methods with options end on a brace.
+  }
+  return "";
+}
+
+}  // namespace
+
+bool SourceInfoMatches(const google::protobuf::FileDescriptorProto& file_proto,
+                       absl::string_view source) {
+  std::vector<absl::string_view> lines = absl::StrSplit(source, '\n');
+  for (const auto& location : file_proto.source_code_info().location()) {
+    const RepeatedField<int32_t>& span = location.span();
+    if (span.size() != 3 && span.size() != 4) {
+      return false;
+    }
+    if (location.path().empty()) {
+      // The whole file, which has grown if anything follows its last token.
+      if (!SpansWholeSource(source, lines, span)) {
+        return false;
+      }
+      continue;
+    }
+    // Declarations that gained or lost lines no longer end where they did.
+    absl::string_view ends = DeclarationEnds(file_proto, location.path());
+    if (!ends.empty()) {
+      absl::optional<char> last = LastSpanChar(lines, span);
+      if (!last.has_value() || !absl::StrContains(ends, *last)) {
+        return false;
+      }
+    }
+    if (span.size() != 3) {
+      continue;  // Only the ends of spans over several lines are checked.
+    }
+    absl::optional<absl::string_view> text = SpanText(lines, span);
+    if (!text.has_value() ||
+        !PathMatches(file_proto, location.path(), *text)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace kythe
@@ -0,0 +1,41 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KYTHE_CXX_INDEXER_PROTO_SOURCE_INFO_CHECK_H_
+#define KYTHE_CXX_INDEXER_PROTO_SOURCE_INFO_CHECK_H_
+
+#include "absl/strings/string_view.h"
+#include "google/protobuf/descriptor.pb.h"
+
+namespace kythe {
+
+// Returns whether the source info of `file_proto`, a precompiled descriptor,
+// agrees with `source`: every span recorded for a declaration's name, label,
+// type, type reference or field number covers that text in `source`, every
+// declaration ends on its closing brace or semicolon, and the file's own span
+// ends on the last token of `source`.
+//
+// A FileDescriptorSet doesn't record which source it was compiled from, so
+// this is how the indexer tells that a descriptor is stale. Any edit that
+// moves a declaration, adds one, or changes one of those tokens in place, is
+// caught; edits that leave all of them where they were (say, to a trailing
+// comment or an option) are not.
+bool SourceInfoMatches(const google::protobuf::FileDescriptorProto& file_proto,
+                       absl::string_view source);
+
+}  // namespace kythe
+
+#endif  // KYTHE_CXX_INDEXER_PROTO_SOURCE_INFO_CHECK_H_
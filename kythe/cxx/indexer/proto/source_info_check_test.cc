@@ -0,0 +1,153 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/indexer/proto/source_info_check.h"
+
+#include <initializer_list>
+#include <string>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+namespace kythe {
+namespace {
+
+using ::google::protobuf::FileDescriptorProto;
+
+constexpr char kSource[] = R"(syntax = "proto2";
+package pkg;
+
+message Outer {
+  optional Outer outer = 1;
+	repeated int32 ids = 0x2;
+  map<string, Outer> outers = 3;
+}
+)";
+
+// The descriptor protoc compiles from kSource, with part of its source info.
+FileDescriptorProto Compiled() {
+  FileDescriptorProto file_proto;
+  EXPECT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      R"(name: "file.proto"
+         package: "pkg"
+         message_type {
+           name: "Outer"
+           field {
+             name: "outer" number: 1 label: LABEL_OPTIONAL
+             type: TYPE_MESSAGE type_name: ".pkg.Outer"
+           }
+           field {
+             name: "ids" number: 2 label: LABEL_REPEATED type: TYPE_INT32
+           }
+           field {
+             name: "outers" number: 3 label: LABEL_REPEATED
+             type: TYPE_MESSAGE type_name: ".pkg.Outer.OutersEntry"
+           }
+         })",
+      &file_proto));
+  auto add_location = [&](std::initializer_list<int> path, int line,
+                          int begin, int end) {
+    auto* location = file_proto.mutable_source_code_info()->add_location();
+    for (int element : path) location->add_path(element);
+    location->add_span(line);
+    location->add_span(begin);
+    location->add_span(end);
+  };
+  auto add_lines = [&](std::initializer_list<int> path,
+                       std::initializer_list<int> span) {
+    auto* location = file_proto.mutable_source_code_info()->add_location();
+    for (int element : path) location->add_path(element);
+    for (int position : span) location->add_span(position);
+  };
+  add_lines({}, {0, 0, 7, 1});                  // The whole file
+  add_lines({4, 0}, {3, 0, 7, 1});              // Outer's declaration
+  add_location({2}, 1, 0, 12);                  // package
+  add_location({4, 0, 1}, 3, 8, 13);            // Outer
+  add_location({4, 0, 2, 0}, 4, 2, 27);         // outer's declaration
+  add_location({4, 0, 2, 0, 4}, 4, 2, 10);      // optional
+  add_location({4, 0, 2, 0, 6}, 4, 11, 16);     // outer's type_name
+  add_location({4, 0, 2, 0, 1}, 4, 17, 22);     // outer
+  add_location({4, 0, 2, 0, 3}, 4, 25, 26);     // 1
+  add_location({4, 0, 2, 1}, 5, 8, 33);        // ids's declaration
+  add_location({4, 0, 2, 1, 4}, 5, 8, 16);      // repeated
+  add_location({4, 0, 2, 1, 5}, 5, 17, 22);     // ids's type
+  add_location({4, 0, 2, 1, 1}, 5, 23, 26);     // ids
+  add_location({4, 0, 2, 1, 3}, 5, 29, 32);     // 0x2
+  add_location({4, 0, 2, 2}, 6, 2, 32);        // outers's declaration
+  add_location({4, 0, 2, 2, 6}, 6, 2, 20);      // map<string, Outer>
+  add_location({4, 0, 2, 2, 1}, 6, 21, 27);     // outers
+  return file_proto;
+}
+
+// Returns kSource with the first `from` replaced by `to`.
+std::string Edited(const std::string& from, const std::string& to) {
+  std::string source = kSource;
+  source.replace(source.find(from), from.size(), to);
+  return source;
+}
+
+TEST(SourceInfoCheckTest, MatchesOwnSource) {
+  EXPECT_TRUE(SourceInfoMatches(Compiled(), kSource));
+}
+
+TEST(SourceInfoCheckTest, MatchesWithoutSourceInfo) {
+  FileDescriptorProto file_proto = Compiled();
+  file_proto.clear_source_code_info();
+  EXPECT_TRUE(SourceInfoMatches(file_proto, ""));
+}
+
+TEST(SourceInfoCheckTest, IgnoresUncheckedEdits) {
+  EXPECT_TRUE(SourceInfoMatches(Compiled(), Edited("}\n", "}  // Done.\n")));
+  EXPECT_TRUE(SourceInfoMatches(Compiled(), std::string(kSource) + "/* */\n"));
+}
+
+TEST(SourceInfoCheckTest, RejectsMovedDeclarations) {
+  EXPECT_FALSE(SourceInfoMatches(Compiled(), "\n" + std::string(kSource)));
+  EXPECT_FALSE(SourceInfoMatches(Compiled(), Edited("message", " message")));
+  EXPECT_FALSE(SourceInfoMatches(Compiled(), Edited("\t", "  ")));
+}
+
+TEST(SourceInfoCheckTest, RejectsTruncatedSource) {
+  EXPECT_FALSE(SourceInfoMatches(Compiled(), std::string(kSource, 100)));
+}
+
+TEST(SourceInfoCheckTest, RejectsAppendedDeclarations) {
+  EXPECT_FALSE(SourceInfoMatches(Compiled(),
+                                 std::string(kSource) + "message Added {}\n"));
+  EXPECT_FALSE(SourceInfoMatches(
+      Compiled(), Edited("}\n", "  optional int32 added = 4;\n}\n")));
+}
+
+TEST(SourceInfoCheckTest, RejectsRenames) {
+  EXPECT_FALSE(SourceInfoMatches(Compiled(), Edited("outer =", "other =")));
+}
+
+TEST(SourceInfoCheckTest, RejectsChangedNumbers) {
+  EXPECT_FALSE(SourceInfoMatches(Compiled(), Edited("0x2", "0x3")));
+}
+
+TEST(SourceInfoCheckTest, RejectsChangedTypes) {
+  EXPECT_FALSE(SourceInfoMatches(Compiled(), Edited("int32", "int64")));
+  EXPECT_FALSE(SourceInfoMatches(Compiled(), Edited("l Outer", "l Other")));
+}
+
+TEST(SourceInfoCheckTest, RejectsChangedLabels) {
+  EXPECT_FALSE(SourceInfoMatches(Compiled(), Edited("optional", "repeated")));
+  EXPECT_FALSE(SourceInfoMatches(Compiled(), Edited("repeated", "required")));
+}
+
+}  // namespace
+}  // namespace kythe
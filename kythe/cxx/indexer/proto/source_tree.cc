@@ -17,36 +17,26 @@
 #include "kythe/cxx/indexer/proto/source_tree.h"
 
 #include "absl/container/flat_hash_map.h"
-#include "absl/strings/str_join.h"
-#include "absl/strings/str_replace.h"
-#include "absl/strings/str_split.h"
-#include "absl/strings/strip.h"
 #include "glog/logging.h"
 #include "google/protobuf/io/zero_copy_stream_impl_lite.h"
 #include "google/protobuf/stubs/map_util.h"
-#include "kythe/cxx/common/path_utils.h"
 
 namespace kythe {
 
-using ::google::protobuf::FindOrDie;
 using ::google::protobuf::FindOrNull;
 using ::google::protobuf::InsertIfNotPresent;
 
-namespace {
-
-// TODO(justbuchanan): why isn't there a replace_all=false version of
-// StrReplace() in open-source abseil?
-/// Finds the first occurrence of @oldsub in @s and replaces it with @newsub. If
-/// @oldsub is not present, just returns @s.
-std::string StringReplaceFirst(absl::string_view s, absl::string_view oldsub,
-                               absl::string_view newsub) {
-  return absl::StrJoin(absl::StrSplit(s, absl::MaxSplits(oldsub, 1)), newsub);
-}
-
-}  // namespace
-
 bool PreloadedProtoFileTree::AddFile(const std::string& filename,
                                      const std::string& contents) {
+  if (file_map_.contains(filename)) {
+    return false;
+  }
+  owned_contents_.push_back(contents);
+  return AddFileView(filename, owned_contents_.back());
+}
+
+bool PreloadedProtoFileTree::AddFileView(const std::string& filename,
+                                         absl::string_view contents) {
   VLOG(1) << filename << " added to PreloadedProtoFileTree";
   return InsertIfNotPresent(&file_map_, filename, contents);
 }
@@ -55,9 +45,10 @@ google::protobuf::io::ZeroCopyInputStream* PreloadedProtoFileTree::Open(
     const std::string& filename) {
   last_error_ = "";
 
-  const std::string* cached_path = FindOrNull(*file_mapping_cache_, filename);
+  const std::string* cached_path = file_mapping_cache_->FindFullPath(filename);
   if (cached_path != nullptr) {
-    std::string* stored_contents = FindOrNull(file_map_, *cached_path);
+    const absl::string_view* stored_contents =
+        FindOrNull(file_map_, *cached_path);
     if (stored_contents == nullptr) {
       last_error_ = "Proto file Open(" + filename +
                     ") failed:" + " cached mapping to " + *cached_path +
@@ -68,33 +59,30 @@ google::protobuf::io::ZeroCopyInputStream* PreloadedProtoFileTree::Open(
     return new google::protobuf::io::ArrayInputStream(stored_contents->data(),
                                                       stored_contents->size());
   }
-  for (auto& substitution : *substitutions_) {
-    std::string found_path;
-    if (substitution.first.empty()) {
-      found_path = CleanPath(JoinPath(substitution.second, filename));
-    } else if (filename == substitution.first) {
-      found_path = substitution.second;
-    } else if (absl::StartsWith(filename, substitution.first + "/")) {
-      found_path = CleanPath(StringReplaceFirst(filename, substitution.first,
-                                                substitution.second));
-    }
-    std::string* stored_contents =
-        found_path.empty() ? nullptr : FindOrNull(file_map_, found_path);
-    if (stored_contents != nullptr) {
-      VLOG(1) << "Proto file Open(" << filename << ") under ["
-              << substitution.first << "->" << substitution.second << "]";
-      if (!InsertIfNotPresent(file_mapping_cache_, filename, found_path)) {
-        LOG(ERROR) << "Redundant/contradictory data in index or internal bug."
-                   << "  \"" << filename << "\" is mapped twice, first to \""
-                   << FindOrDie(*file_mapping_cache_, filename)
-                   << "\" and now to \"" << found_path << "\".  Aborting "
-                   << "new remapping...";
-      }
-      return new google::protobuf::io::ArrayInputStream(
-          stored_contents->data(), stored_contents->size());
-    }
+  const absl::string_view* stored_contents = nullptr;
+  search_path_.VisitRealPaths(
+      filename, [&](const std::string& found_path,
+                    const std::pair<std::string, std::string>& substitution) {
+        stored_contents = FindOrNull(file_map_, found_path);
+        if (stored_contents == nullptr) {
+          return false;
+        }
+        VLOG(1) << "Proto file Open(" << filename << ") under ["
+                << substitution.first << "->" << substitution.second << "]";
+        if (!file_mapping_cache_->Insert(filename, found_path)) {
+          LOG(ERROR) << "Redundant/contradictory data in index or internal "
+                     << "bug.  \"" << filename << "\" is mapped twice, first "
+                     << "to \"" << *file_mapping_cache_->FindFullPath(filename)
+                     << "\" and now to \"" << found_path << "\".  Aborting "
+                     << "new remapping...";
+        }
+        return true;
+      });
+  if (stored_contents != nullptr) {
+    return new google::protobuf::io::ArrayInputStream(stored_contents->data(),
+                                                      stored_contents->size());
   }
-  std::string* stored_contents = FindOrNull(file_map_, filename);
+  stored_contents = FindOrNull(file_map_, filename);
   if (stored_contents != nullptr) {
     VLOG(1) << "Proto file Open(" << filename << ") at root";
     return new google::protobuf::io::ArrayInputStream(stored_contents->data(),
@@ -123,4 +111,15 @@ bool PreloadedProtoFileTree::Read(absl::string_view file_path,
   return true;
 }
 
+absl::optional<std::string> PreloadedProtoFileTree::Resolve(
+    const std::string& filename) {
+  std::unique_ptr<google::protobuf::io::ZeroCopyInputStream> in_stream(
+      Open(filename));
+  if (!in_stream) {
+    return absl::nullopt;
+  }
+  const std::string* full_path = file_mapping_cache_->FindFullPath(filename);
+  return full_path != nullptr ? *full_path : filename;
+}
+
 }  // namespace kythe
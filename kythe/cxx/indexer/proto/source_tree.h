@@ -17,12 +17,17 @@
 #ifndef KYTHE_CXX_INDEXER_PROTO_SOURCE_TREE_H_
 #define KYTHE_CXX_INDEXER_PROTO_SOURCE_TREE_H_
 
+#include <deque>
 #include <string>
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
 #include "google/protobuf/compiler/importer.h"
 #include "google/protobuf/io/zero_copy_stream.h"
+#include "kythe/cxx/indexer/proto/path_substitution_cache.h"
+#include "kythe/cxx/indexer/proto/search_path.h"
 
 namespace kythe {
 
@@ -50,8 +55,8 @@ class PreloadedProtoFileTree : public google::protobuf::compiler::SourceTree {
  public:
   PreloadedProtoFileTree(
       const std::vector<std::pair<std::string, std::string>>* substitutions,
-      absl::flat_hash_map<std::string, std::string>* file_mapping_cache)
-      : substitutions_(substitutions),
+      PathSubstitutionCache* file_mapping_cache)
+      : search_path_(*substitutions),
         file_mapping_cache_(file_mapping_cache) {}
 
   // disallow copy and assign
@@ -63,6 +68,10 @@ class PreloadedProtoFileTree : public google::protobuf::compiler::SourceTree {
   // Returns false if `filename` was already added.
   bool AddFile(const std::string& filename, const std::string& contents);
 
+  // Like AddFile(), but records `contents` without copying it. The referenced
+  // bytes must remain valid for the lifetime of this PreloadedProtoFileTree.
+  bool AddFileView(const std::string& filename, absl::string_view contents);
+
   // Load the full contents of `filename` into `contents`, if possible, and
   // return whether this was successful.
   // Note that ProtoFileParser passes the literal argument to import statements
@@ -78,16 +87,28 @@ class PreloadedProtoFileTree : public google::protobuf::compiler::SourceTree {
   // A wrapper around Open(), that reads the proto file contents into a buffer.
   bool Read(absl::string_view file_path, std::string* out);
 
+  // Returns the full path of the file Open(`filename`) would read, or nullopt
+  // if there is none. Like Open(), this records any substitution used.
+  absl::optional<std::string> Resolve(const std::string& filename);
+
+  // Returns the index of the path substitutions this tree was built with.
+  const lang_proto::SearchPathIndex& search_path() const {
+    return search_path_;
+  }
+
  private:
   // All path prefix substitutions to consider.
-  const std::vector<std::pair<std::string, std::string>>* const substitutions_;
+  const lang_proto::SearchPathIndex search_path_;
 
   // A map of pre-substitution to post-substitution names for all files that
   // have been successfully read via this reader.
-  absl::flat_hash_map<std::string, std::string>* file_mapping_cache_;
+  PathSubstitutionCache* file_mapping_cache_;
 
   // Path (post-substitution) -> file contents.
-  absl::flat_hash_map<std::string, std::string> file_map_;
+  absl::flat_hash_map<std::string, absl::string_view> file_map_;
+
+  // Backing storage for contents added by copy through AddFile().
+  std::deque<std::string> owned_contents_;
 
   // A description of the error from the last call to Open() (if any).
   std::string last_error_;
@@ -0,0 +1,110 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "kythe/cxx/indexer/proto/source_tree.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "gtest/gtest.h"
+#include "kythe/cxx/indexer/proto/path_substitution_cache.h"
+
+namespace kythe {
+namespace {
+
+class PreloadedProtoFileTreeTest : public ::testing::Test {
+ protected:
+  // Returns the contents `tree` serves for `filename`, or nullopt if it can't
+  // be opened.
+  static absl::optional<std::string> Read(PreloadedProtoFileTree* tree,
+                                          const std::string& filename) {
+    std::string contents;
+    if (!tree->Read(filename, &contents)) {
+      return absl::nullopt;
+    }
+    return contents;
+  }
+
+  std::vector<std::pair<std::string, std::string>> substitutions_ = {
+      {"", "root"}};
+  PathSubstitutionCache file_mapping_cache_;
+};
+
+TEST_F(PreloadedProtoFileTreeTest, ServesBorrowedContents) {
+  // Outlives the tree, as AddFileView() requires.
+  const std::string contents = "syntax = \"proto3\";\n";
+  PreloadedProtoFileTree tree(&substitutions_, &file_mapping_cache_);
+  ASSERT_TRUE(tree.AddFileView("root/borrowed.proto", contents));
+
+  // The tree reads the caller's buffer in place.
+  std::unique_ptr<google::protobuf::io::ZeroCopyInputStream> in(
+      tree.Open("borrowed.proto"));
+  ASSERT_NE(in, nullptr);
+  const void* data = nullptr;
+  int size = 0;
+  ASSERT_TRUE(in->Next(&data, &size));
+  EXPECT_EQ(data, contents.data());
+  EXPECT_EQ(static_cast<size_t>(size), contents.size());
+
+  auto read = Read(&tree, "borrowed.proto");
+  ASSERT_TRUE(read.has_value());
+  EXPECT_EQ(*read, contents);
+}
+
+TEST_F(PreloadedProtoFileTreeTest, KeepsCopiesOfAddedContents) {
+  PreloadedProtoFileTree tree(&substitutions_, &file_mapping_cache_);
+  {
+    std::string contents = "syntax = \"proto2\";\n";
+    ASSERT_TRUE(tree.AddFile("root/copied.proto", contents));
+    contents.assign(contents.size(), 'x');
+  }
+  // Later copies must not move earlier ones.
+  for (int i = 0; i < 100; ++i) {
+    std::string filename = "root/other" + std::to_string(i) + ".proto";
+    ASSERT_TRUE(tree.AddFile(filename, std::string(i, 'y')));
+  }
+
+  auto read = Read(&tree, "copied.proto");
+  ASSERT_TRUE(read.has_value());
+  EXPECT_EQ(*read, "syntax = \"proto2\";\n");
+  read = Read(&tree, "other99.proto");
+  ASSERT_TRUE(read.has_value());
+  EXPECT_EQ(*read, std::string(99, 'y'));
+}
+
+TEST_F(PreloadedProtoFileTreeTest, RejectsFilesAddedTwice) {
+  const std::string contents = "package first;\n";
+  PreloadedProtoFileTree tree(&substitutions_, &file_mapping_cache_);
+  ASSERT_TRUE(tree.AddFileView("root/file.proto", contents));
+  EXPECT_FALSE(tree.AddFile("root/file.proto", "package second;\n"));
+  EXPECT_FALSE(tree.AddFileView("root/file.proto", "package third;\n"));
+
+  auto read = Read(&tree, "file.proto");
+  ASSERT_TRUE(read.has_value());
+  EXPECT_EQ(*read, contents);
+}
+
+TEST_F(PreloadedProtoFileTreeTest, FailsOnMissingFile) {
+  PreloadedProtoFileTree tree(&substitutions_, &file_mapping_cache_);
+  EXPECT_FALSE(Read(&tree, "missing.proto").has_value());
+  EXPECT_NE(tree.GetLastErrorMessage(), "");
+}
+
+}  // namespace
+}  // namespace kythe
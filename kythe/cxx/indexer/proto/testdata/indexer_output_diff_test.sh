@@ -0,0 +1,35 @@
+#!/bin/bash
+# Copyright 2019 The Kythe Authors. All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Indexes a kzip with and without the given indexer flags and checks that the
+# two entry streams are byte-for-byte identical.
+#
+# Usage: indexer_output_diff_test.sh INDEXER KZIP INDEXER_FLAGS...
+
+set -e
+
+INDEXER=$1; shift
+KZIP=$1; shift
+
+EXPECTED="${TEST_TMPDIR}/expected.entries"
+ACTUAL="${TEST_TMPDIR}/actual.entries"
+"${INDEXER}" --index_file "${KZIP}" -o "${EXPECTED}"
+"${INDEXER}" "$@" --index_file "${KZIP}" -o "${ACTUAL}"
+
+if ! cmp "${EXPECTED}" "${ACTUAL}"; then
+  echo "Indexer output with $* differs from the default output"
+  exit 1
+fi
+echo "Indexer output with $* matches the default output"
@@ -28,15 +28,21 @@ def _invoke(rulefn, name, **kwargs):
     return "//{}:{}".format(native.package_name(), name)
 
 def _proto_extract_kzip_impl(ctx):
+    flags = []
+    if ctx.files.descriptor_sets:
+        flags.append("--descriptor_set_in=" + ":".join([
+            f.path
+            for f in ctx.files.descriptor_sets
+        ]))
     extract(
         srcs = ctx.files.srcs,
         ctx = ctx,
         extractor = ctx.executable.extractor,
         kzip = ctx.outputs.kzip,
         mnemonic = "ProtoExtractKZip",
-        opts = ["--", "--proto_path", ctx.label.package] + ctx.attr.opts,
+        opts = flags + ["--", "--proto_path", ctx.label.package] + ctx.attr.opts,
         vnames_config = ctx.file.vnames_config,
-        deps = ctx.files.deps,
+        deps = ctx.files.deps + ctx.files.descriptor_sets,
     )
     return [KytheVerifierSources(files = depset(ctx.files.srcs))]
 
@@ -48,6 +54,7 @@ proto_extract_kzip = rule(
             allow_files = True,
         ),
         "deps": attr.label_list(allow_files = True),
+        "descriptor_sets": attr.label_list(allow_files = True),
         "extractor": attr.label(
             default = Label("@io_kythe_lang_proto//kythe/cxx/extractor/proto:proto_extractor"),
             executable = True,
@@ -72,6 +79,7 @@ def proto_verifier_test(
         tags = [],
         extractor = None,
         extractor_opts = [],
+        descriptor_sets = [],
         indexer_opts = [],
         verifier_opts = [],
         expect_success = True,
@@ -86,6 +94,7 @@ def proto_verifier_test(
       meta: Optional list of Kythe metadata files
       extractor: Executable extractor tool to invoke (defaults to protoc_extractor)
       extractor_opts: List of options passed to the extractor tool
+      descriptor_sets: Optional list of FileDescriptorSets to embed with --descriptor_set_in
       indexer_opts: List of options passed to the indexer tool
       verifier_opts: List of options passed to the verifier tool
       vnames_config: Optional path to a VName configuration file
@@ -97,6 +106,7 @@ def proto_verifier_test(
         srcs = srcs,
         extractor = extractor,
         opts = extractor_opts,
+        descriptor_sets = descriptor_sets,
         tags = tags,
         visibility = visibility,
         vnames_config = vnames_config,
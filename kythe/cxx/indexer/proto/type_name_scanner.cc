@@ -0,0 +1,127 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/indexer/proto/type_name_scanner.h"
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/strip.h"
+
+namespace kythe {
+namespace lang_proto {
+namespace {
+
+// Skips whitespace and comments at the front of `text`.
+void SkipIgnored(absl::string_view* text) {
+  while (!text->empty()) {
+    if (absl::ascii_isspace(text->front())) {
+      text->remove_prefix(1);
+    } else if (absl::ConsumePrefix(text, "//")) {
+      size_t eol = text->find('\n');
+      text->remove_prefix(eol == absl::string_view::npos ? text->size() : eol);
+    } else if (absl::ConsumePrefix(text, "/*")) {
+      size_t end = text->find("*/");
+      text->remove_prefix(end == absl::string_view::npos ? text->size()
+                                                         : end + 2);
+    } else {
+      return;
+    }
+  }
+}
+
+// Consumes a single identifier from the front of `text`. Returns false if
+// there is none.
+bool ConsumeIdentifier(absl::string_view* text) {
+  if (text->empty() ||
+      !(absl::ascii_isalpha(text->front()) || text->front() == '_')) {
+    return false;
+  }
+  size_t len = 1;
+  while (len < text->size() &&
+         (absl::ascii_isalnum((*text)[len]) || (*text)[len] == '_')) {
+    ++len;
+  }
+  text->remove_prefix(len);
+  return true;
+}
+
+// Consumes `c` from the front of `text`, after any whitespace or comments.
+bool ConsumeSymbol(absl::string_view* text, char c) {
+  absl::string_view rest = *text;
+  SkipIgnored(&rest);
+  if (rest.empty() || rest.front() != c) {
+    return false;
+  }
+  rest.remove_prefix(1);
+  *text = rest;
+  return true;
+}
+
+}  // namespace
+
+absl::string_view ConsumeTypeName(absl::string_view* text) {
+  absl::string_view rest = *text;
+  SkipIgnored(&rest);
+  const char* begin = rest.data();
+  // A leading '.' marks a fully-qualified name.
+  if (!rest.empty() && rest.front() == '.') {
+    rest.remove_prefix(1);
+    SkipIgnored(&rest);
+  }
+  if (!ConsumeIdentifier(&rest)) {
+    return absl::string_view();
+  }
+  const char* end = rest.data();
+  for (;;) {
+    absl::string_view next = rest;
+    if (!ConsumeSymbol(&next, '.')) {
+      break;
+    }
+    SkipIgnored(&next);
+    if (!ConsumeIdentifier(&next)) {
+      break;
+    }
+    rest = next;
+    end = rest.data();
+  }
+  *text = absl::string_view(end, text->data() + text->size() - end);
+  return absl::string_view(begin, end - begin);
+}
+
+bool FindMapTypeNames(absl::string_view text, absl::string_view* key,
+                      absl::string_view* value) {
+  SkipIgnored(&text);
+  if (!absl::ConsumePrefix(&text, "map") || !ConsumeSymbol(&text, '<')) {
+    return false;
+  }
+  absl::string_view key_name = ConsumeTypeName(&text);
+  if (key_name.empty() || !ConsumeSymbol(&text, ',')) {
+    return false;
+  }
+  absl::string_view value_name = ConsumeTypeName(&text);
+  if (value_name.empty() || !ConsumeSymbol(&text, '>')) {
+    return false;
+  }
+  SkipIgnored(&text);
+  if (!text.empty()) {
+    return false;
+  }
+  *key = key_name;
+  *value = value_name;
+  return true;
+}
+
+}  // namespace lang_proto
+}  // namespace kythe
@@ -0,0 +1,45 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KYTHE_CXX_INDEXER_PROTO_TYPE_NAME_SCANNER_H_
+#define KYTHE_CXX_INDEXER_PROTO_TYPE_NAME_SCANNER_H_
+
+#include "absl/strings/string_view.h"
+
+namespace kythe {
+namespace lang_proto {
+
+// Helpers for locating type names within spans of proto source text that the
+// proto compiler's SourceCodeInfo describes only as a whole. All returned
+// views point into the input text; nothing is allocated.
+
+// Consumes a (possibly qualified) type name such as "Foo", "foo.Bar" or
+// ".foo.Bar" from the front of `text`, skipping any leading whitespace and
+// comments. Whitespace and comments between the components of a qualified
+// name are allowed, as they are by protoc. Returns the consumed name, or an
+// empty view (leaving `text` untouched) if `text` does not start with one.
+absl::string_view ConsumeTypeName(absl::string_view* text);
+
+// Finds the key and value type names within `text`, which is expected to hold
+// exactly a map field type such as "map<string, foo.Bar>". Returns false if
+// `text` is not a well-formed map type.
+bool FindMapTypeNames(absl::string_view text, absl::string_view* key,
+                      absl::string_view* value);
+
+}  // namespace lang_proto
+}  // namespace kythe
+
+#endif  // KYTHE_CXX_INDEXER_PROTO_TYPE_NAME_SCANNER_H_
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/indexer/proto/type_name_scanner.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace kythe {
+namespace lang_proto {
+namespace {
+
+using ::testing::Eq;
+
+TEST(TypeNameScannerTest, SimpleName) {
+  absl::string_view text = "  Foo bar";
+  EXPECT_THAT(ConsumeTypeName(&text), Eq("Foo"));
+  EXPECT_THAT(text, Eq(" bar"));
+}
+
+TEST(TypeNameScannerTest, QualifiedName) {
+  absl::string_view text = ".foo.bar.Baz = 1;";
+  EXPECT_THAT(ConsumeTypeName(&text), Eq(".foo.bar.Baz"));
+  EXPECT_THAT(text, Eq(" = 1;"));
+}
+
+TEST(TypeNameScannerTest, QualifiedNameWithSpaces) {
+  absl::string_view text = "foo . /* c */ Bar>";
+  EXPECT_THAT(ConsumeTypeName(&text), Eq("foo . /* c */ Bar"));
+  EXPECT_THAT(text, Eq(">"));
+}
+
+TEST(TypeNameScannerTest, NotAName) {
+  absl::string_view text = " 3abc";
+  EXPECT_THAT(ConsumeTypeName(&text), Eq(""));
+  EXPECT_THAT(text, Eq(" 3abc"));
+}
+
+TEST(TypeNameScannerTest, MapTypes) {
+  absl::string_view text = "map<string, foo.Bar>";
+  absl::string_view key, value;
+  ASSERT_TRUE(FindMapTypeNames(text, &key, &value));
+  EXPECT_THAT(key, Eq("string"));
+  EXPECT_THAT(value, Eq("foo.Bar"));
+  // The results point into the input.
+  EXPECT_THAT(key.data() - text.data(), Eq(4));
+  EXPECT_THAT(value.data() - text.data(), Eq(12));
+}
+
+TEST(TypeNameScannerTest, MapTypesWithoutSpaces) {
+  absl::string_view key, value;
+  ASSERT_TRUE(FindMapTypeNames("map<int32,.a.B>", &key, &value));
+  EXPECT_THAT(key, Eq("int32"));
+  EXPECT_THAT(value, Eq(".a.B"));
+}
+
+TEST(TypeNameScannerTest, MapTypesWithComments) {
+  absl::string_view key, value;
+  ASSERT_TRUE(FindMapTypeNames(" map < // key\n string ,\n /* v */ Foo > ",
+                               &key, &value));
+  EXPECT_THAT(key, Eq("string"));
+  EXPECT_THAT(value, Eq("Foo"));
+}
+
+TEST(TypeNameScannerTest, MalformedMapTypes) {
+  absl::string_view key, value;
+  EXPECT_FALSE(FindMapTypeNames("", &key, &value));
+  EXPECT_FALSE(FindMapTypeNames("Foo", &key, &value));
+  EXPECT_FALSE(FindMapTypeNames("map<string>", &key, &value));
+  EXPECT_FALSE(FindMapTypeNames("map<string, Foo", &key, &value));
+  EXPECT_FALSE(FindMapTypeNames("map<string, Foo> x", &key, &value));
+}
+
+}  // namespace
+}  // namespace lang_proto
+}  // namespace kythe
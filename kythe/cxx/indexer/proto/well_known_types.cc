@@ -0,0 +1,70 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/indexer/proto/well_known_types.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "glog/logging.h"
+#include "kythe/cxx/indexer/proto/well_known_types_data.h"
+
+namespace kythe {
+namespace {
+
+// A compiled well-known type file.
+struct CompiledFile {
+  // The digest of the source `file` was compiled from.
+  std::string sha256;
+  google::protobuf::FileDescriptorProto file;
+};
+
+// Returns the compiled files, by name.
+const absl::flat_hash_map<std::string, CompiledFile>& CompiledFiles() {
+  static const auto* files = [] {
+    auto* files = new absl::flat_hash_map<std::string, CompiledFile>();
+    google::protobuf::FileDescriptorSet set;
+    CHECK(set.ParseFromArray(kWellKnownTypesDescriptorSet,
+                             kWellKnownTypesDescriptorSetSize))
+        << "Corrupt well-known types descriptor set";
+    for (auto& file : *set.mutable_file()) {
+      (*files)[file.name()].file.Swap(&file);
+    }
+    for (size_t i = 0; i < kWellKnownTypesFileCount; ++i) {
+      auto found = files->find(kWellKnownTypesFiles[i].name);
+      if (found != files->end()) {
+        found->second.sha256 = kWellKnownTypesFiles[i].sha256;
+      }
+    }
+    return files;
+  }();
+  return *files;
+}
+
+}  // namespace
+
+bool WellKnownTypesDatabase::FindFileByName(
+    const std::string& filename,
+    google::protobuf::FileDescriptorProto* output) {
+  const auto& compiled_files = CompiledFiles();
+  auto found = compiled_files.find(filename);
+  if (found != compiled_files.end() && !found->second.sha256.empty() &&
+      digest_lookup_(filename) == found->second.sha256) {
+    *output = found->second.file;
+    return true;
+  }
+  return fallback_db_->FindFileByName(filename, output);
+}
+
+}  // namespace kythe
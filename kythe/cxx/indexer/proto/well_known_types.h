@@ -0,0 +1,78 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KYTHE_CXX_INDEXER_PROTO_WELL_KNOWN_TYPES_H_
+#define KYTHE_CXX_INDEXER_PROTO_WELL_KNOWN_TYPES_H_
+
+#include <functional>
+#include <string>
+#include <utility>
+
+#include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/descriptor_database.h"
+
+namespace kythe {
+
+// A DescriptorDatabase serving the protobuf well-known types (any.proto,
+// descriptor.proto, timestamp.proto, ...) from descriptors, with source info,
+// that were compiled into the binary at build time. A file is only served
+// when the source it resolves to has the same digest as the one it was
+// compiled from; anything else is looked up in a fallback database, usually
+// one that parses source text.
+//
+// This is a database rather than an underlay DescriptorPool because a pool
+// cannot have both an underlay and a fallback database, and the indexers need
+// the FileDescriptorProto (for its SourceCodeInfo) of every file they walk.
+// The compiled descriptors are deserialized once per process.
+class WellKnownTypesDatabase : public google::protobuf::DescriptorDatabase {
+ public:
+  // Returns the digest of the contents of the file `filename` resolves to,
+  // or an empty string if it is unknown.
+  using DigestLookup = std::function<std::string(const std::string& filename)>;
+
+  // `fallback_db` must outlive this database.
+  WellKnownTypesDatabase(DigestLookup digest_lookup,
+                         google::protobuf::DescriptorDatabase* fallback_db)
+      : digest_lookup_(std::move(digest_lookup)), fallback_db_(fallback_db) {}
+
+  // disallow copy and assign
+  WellKnownTypesDatabase(const WellKnownTypesDatabase&) = delete;
+  void operator=(const WellKnownTypesDatabase&) = delete;
+
+  bool FindFileByName(const std::string& filename,
+                      google::protobuf::FileDescriptorProto* output) override;
+
+  // Like SourceTreeDescriptorDatabase, symbols can't be searched for without
+  // knowing which file defines them.
+  bool FindFileContainingSymbol(
+      const std::string& symbol_name,
+      google::protobuf::FileDescriptorProto* output) override {
+    return false;
+  }
+  bool FindFileContainingExtension(
+      const std::string& containing_type, int field_number,
+      google::protobuf::FileDescriptorProto* output) override {
+    return false;
+  }
+
+ private:
+  const DigestLookup digest_lookup_;
+  google::protobuf::DescriptorDatabase* fallback_db_;
+};
+
+}  // namespace kythe
+
+#endif  // KYTHE_CXX_INDEXER_PROTO_WELL_KNOWN_TYPES_H_
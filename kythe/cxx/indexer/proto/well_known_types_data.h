@@ -0,0 +1,45 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KYTHE_CXX_INDEXER_PROTO_WELL_KNOWN_TYPES_DATA_H_
+#define KYTHE_CXX_INDEXER_PROTO_WELL_KNOWN_TYPES_DATA_H_
+
+#include <cstddef>
+
+// Data compiled into the indexers at build time by embed_descriptor_set.py.
+// Use WellKnownTypesDatabase rather than these directly.
+
+namespace kythe {
+
+// A .proto source file compiled into kWellKnownTypesDescriptorSet.
+struct EmbeddedProtoFile {
+  // The name the file is imported by, e.g. "google/protobuf/any.proto".
+  const char* name;
+  // The hex SHA-256 digest of the source the descriptor was compiled from.
+  const char* sha256;
+};
+
+// A serialized FileDescriptorSet, with source info, of the well-known types.
+extern const char kWellKnownTypesDescriptorSet[];
+extern const size_t kWellKnownTypesDescriptorSetSize;
+
+// The sources of the files in kWellKnownTypesDescriptorSet.
+extern const EmbeddedProtoFile kWellKnownTypesFiles[];
+extern const size_t kWellKnownTypesFileCount;
+
+}  // namespace kythe
+
+#endif  // KYTHE_CXX_INDEXER_PROTO_WELL_KNOWN_TYPES_DATA_H_
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/indexer/proto/well_known_types.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "kythe/cxx/indexer/proto/well_known_types_data.h"
+
+namespace kythe {
+namespace {
+
+using ::google::protobuf::FileDescriptorProto;
+using ::google::protobuf::SimpleDescriptorDatabase;
+
+// Returns a lookup giving every file the digest `digest`.
+WellKnownTypesDatabase::DigestLookup Digest(std::string digest) {
+  return [digest](const std::string&) { return digest; };
+}
+
+TEST(WellKnownTypesDatabaseTest, ServesCompiledFilesWithMatchingDigests) {
+  ASSERT_GT(kWellKnownTypesFileCount, 0u);
+  SimpleDescriptorDatabase empty_db;
+  for (size_t i = 0; i < kWellKnownTypesFileCount; ++i) {
+    const EmbeddedProtoFile& compiled = kWellKnownTypesFiles[i];
+    WellKnownTypesDatabase db(Digest(compiled.sha256), &empty_db);
+    FileDescriptorProto file;
+    ASSERT_TRUE(db.FindFileByName(compiled.name, &file)) << compiled.name;
+    EXPECT_EQ(file.name(), compiled.name);
+    EXPECT_TRUE(file.has_source_code_info()) << compiled.name;
+  }
+}
+
+TEST(WellKnownTypesDatabaseTest, FallsBackForChangedFiles) {
+  FileDescriptorProto changed;
+  changed.set_name("google/protobuf/any.proto");
+  changed.set_package("changed");
+  SimpleDescriptorDatabase fallback_db;
+  ASSERT_TRUE(fallback_db.Add(changed));
+
+  WellKnownTypesDatabase db(Digest("1234"), &fallback_db);
+  FileDescriptorProto file;
+  ASSERT_TRUE(db.FindFileByName("google/protobuf/any.proto", &file));
+  EXPECT_EQ(file.package(), "changed");
+  EXPECT_FALSE(db.FindFileByName("google/protobuf/empty.proto", &file));
+}
+
+TEST(WellKnownTypesDatabaseTest, FallsBackForFilesWithoutDigests) {
+  SimpleDescriptorDatabase empty_db;
+  WellKnownTypesDatabase db(Digest(""), &empty_db);
+  FileDescriptorProto file;
+  EXPECT_FALSE(db.FindFileByName("google/protobuf/any.proto", &file));
+}
+
+}  // namespace
+}  // namespace kythe
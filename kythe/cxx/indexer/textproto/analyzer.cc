@@ -16,21 +16,34 @@
 
 #include "analyzer.h"
 
+#include <algorithm>
+#include <atomic>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/container/node_hash_map.h"
+#include "absl/strings/ascii.h"
 #include "absl/strings/match.h"
-#include "absl/strings/strip.h"
+#include "absl/strings/str_cat.h"
 #include "absl/types/optional.h"
 #include "google/protobuf/descriptor.h"
 #include "google/protobuf/descriptor_database.h"
 #include "google/protobuf/dynamic_message.h"
+#include "google/protobuf/io/tokenizer.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
 #include "google/protobuf/text_format.h"
 #include "kythe/cxx/common/indexing/KytheGraphRecorder.h"
-#include "kythe/cxx/common/path_utils.h"
 #include "kythe/cxx/common/utf8_line_index.h"
+#include "kythe/cxx/indexer/proto/buffered_output.h"
+#include "kythe/cxx/indexer/proto/parse_cache.h"
+#include "kythe/cxx/indexer/proto/path_substitution_cache.h"
 #include "kythe/cxx/indexer/proto/search_path.h"
 #include "kythe/cxx/indexer/proto/source_tree.h"
 #include "kythe/cxx/indexer/proto/vname_util.h"
+#include "kythe/cxx/indexer/proto/well_known_types.h"
 #include "kythe/proto/analysis.pb.h"
 
 namespace kythe {
@@ -43,13 +56,19 @@ namespace {
 using ::google::protobuf::Descriptor;
 using ::google::protobuf::DescriptorPool;
 using ::google::protobuf::FieldDescriptor;
+using ::google::protobuf::FileDescriptor;
 using ::google::protobuf::Message;
 using ::google::protobuf::Reflection;
 using ::google::protobuf::TextFormat;
+using ::google::protobuf::io::Tokenizer;
 
 // Repeated fields have an actual index, non-repeated fields are always -1.
 constexpr int kNonRepeatedFieldIndex = -1;
 
+// Maximum nesting of messages and lists accepted when streaming a textproto.
+// This matches the default recursion limit of TextFormat::Parser.
+constexpr int kMaxStreamingDepth = 100;
+
 // Error "collector" that just writes messages to log output.
 class LoggingMultiFileErrorCollector
     : public google::protobuf::compiler::MultiFileErrorCollector {
@@ -65,6 +84,46 @@ class LoggingMultiFileErrorCollector
   }
 };
 
+// Error collector for the streaming tokenizer that keeps the first error.
+class TokenizerErrorCollector : public google::protobuf::io::ErrorCollector {
+ public:
+  void AddError(int line, google::protobuf::io::ColumnNumber column,
+                const std::string& message) override {
+    if (error_.empty()) {
+      error_ = absl::StrCat(line + 1, ":", column + 1, ": ", message);
+    }
+  }
+
+  const std::string& error() const { return error_; }
+
+ private:
+  std::string error_;
+};
+
+// Consumes the current token if it is the symbol `symbol`.
+bool TryConsume(Tokenizer* tokenizer, absl::string_view symbol) {
+  if (tokenizer->current().type == Tokenizer::TYPE_SYMBOL &&
+      tokenizer->current().text == symbol) {
+    tokenizer->Next();
+    return true;
+  }
+  return false;
+}
+
+// Finds the field of `descriptor` named `name` in text format. Group fields
+// are written using the name of their message type rather than the field.
+const FieldDescriptor* FindFieldByTextName(const Descriptor& descriptor,
+                                           const std::string& name) {
+  const FieldDescriptor* field = descriptor.FindFieldByName(name);
+  if (field == nullptr) {
+    field = descriptor.FindFieldByName(absl::AsciiStrToLower(name));
+    if (field != nullptr && field->type() != FieldDescriptor::TYPE_GROUP) {
+      field = nullptr;
+    }
+  }
+  return field;
+}
+
 absl::optional<proto::VName> LookupVNameForFullPath(
     absl::string_view full_path, const proto::CompilationUnit& unit) {
   for (const auto& input : unit.required_input()) {
@@ -75,21 +134,103 @@ absl::optional<proto::VName> LookupVNameForFullPath(
   return absl::nullopt;
 }
 
+// Memoizes the VNames of the fields that the textprotos of a compilation unit
+// refer to, so that each field is resolved once per unit however many
+// textprotos use it. This is safe to use from several threads at once.
+class FieldVNameCache {
+ public:
+  // Note: The FieldVNameCache does not take ownership of its pointer
+  // arguments, so they must outlive it.
+  FieldVNameCache(const proto::CompilationUnit* unit,
+                  const PathSubstitutionCache* file_substitution_cache)
+      : unit_(unit), file_substitution_cache_(file_substitution_cache) {}
+
+  // disallow copy and assign
+  FieldVNameCache(const FieldVNameCache&) = delete;
+  void operator=(const FieldVNameCache&) = delete;
+
+  // Sets `vname_ref` to the VName of `field`, which is computed on first use
+  // and then cached for the life of the cache.
+  Status Lookup(const FieldDescriptor& field, const VNameRef** vname_ref);
+
+ private:
+  absl::optional<proto::VName> VNameForRelPath(
+      absl::string_view simplified_path) const;
+
+  const proto::CompilationUnit* unit_;
+
+  // Proto search paths are used to resolve relative paths to full paths.
+  const PathSubstitutionCache* file_substitution_cache_;
+
+  // A field's VName along with a VNameRef pointing into it.
+  struct FieldVName {
+    proto::VName vname;
+    VNameRef ref;
+  };
+
+  std::mutex mu_;
+  // Memoized results of Lookup(). Nodes are stable, so the cached refs remain
+  // valid as the map grows.
+  absl::node_hash_map<const FieldDescriptor*, FieldVName> field_vnames_;
+};
+
+absl::optional<proto::VName> FieldVNameCache::VNameForRelPath(
+    absl::string_view simplified_path) const {
+  const std::string* full_path =
+      file_substitution_cache_->FindFullPath(simplified_path);
+  return LookupVNameForFullPath(
+      full_path != nullptr ? *full_path : simplified_path, *unit_);
+}
+
+Status FieldVNameCache::Lookup(const FieldDescriptor& field,
+                               const VNameRef** vname_ref) {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto found = field_vnames_.find(&field);
+    if (found != field_vnames_.end()) {
+      *vname_ref = &found->second.ref;
+      return OkStatus();
+    }
+  }
+
+  // Resolve the field without holding the lock; if another thread got there
+  // first, its equal VName is kept.
+  Status vname_lookup_status = OkStatus();
+  proto::VName vname = ::kythe::lang_proto::VNameForDescriptor(
+      &field, [this, &vname_lookup_status](const std::string& path) {
+        auto v = VNameForRelPath(path);
+        if (!v.has_value()) {
+          vname_lookup_status = UnknownError(
+              absl::StrCat("Unable to lookup vname for rel path: ", path));
+          return proto::VName();
+        }
+        return *v;
+      });
+  if (!vname_lookup_status.ok()) return vname_lookup_status;
+
+  std::lock_guard<std::mutex> lock(mu_);
+  auto inserted = field_vnames_.try_emplace(&field);
+  FieldVName& cached = inserted.first->second;
+  if (inserted.second) {
+    cached.vname = std::move(vname);
+    cached.ref = VNameRef(cached.vname);
+  }
+  *vname_ref = &cached.ref;
+  return OkStatus();
+}
+
 // The TextprotoAnalyzer maintains state needed across indexing operations and
 // provides some relevant helper methods.
 class TextprotoAnalyzer {
  public:
   // Note: The TextprotoAnalyzer does not take ownership of its pointer
   // arguments, so they must outlive it.
-  explicit TextprotoAnalyzer(
-      const proto::CompilationUnit* unit, absl::string_view textproto,
-      const absl::flat_hash_map<std::string, std::string>*
-          file_substitution_cache,
-      KytheGraphRecorder* recorder)
-      : unit_(unit),
-        recorder_(recorder),
+  explicit TextprotoAnalyzer(absl::string_view textproto,
+                             FieldVNameCache* field_vnames,
+                             KytheGraphRecorder* recorder)
+      : recorder_(recorder),
         line_index_(textproto),
-        file_substitution_cache_(file_substitution_cache) {}
+        field_vnames_(field_vnames) {}
 
   // disallow copy and assign
   TextprotoAnalyzer(const TextprotoAnalyzer&) = delete;
@@ -101,79 +242,97 @@ class TextprotoAnalyzer {
                         const Descriptor& descriptor,
                         const TextFormat::ParseInfoTree& parse_tree);
 
+  // Analyzes `textproto`, a message of type `descriptor`, directly from its
+  // token stream, emitting "ref" edges for all fields as they are read. No
+  // message or ParseInfoTree is built, so memory use is bounded by nesting
+  // depth rather than by the size of the input.
+  Status AnalyzeTokens(const proto::VName& file_vname,
+                       const Descriptor& descriptor,
+                       absl::string_view textproto);
+
  private:
   Status AnalyzeField(const proto::VName& file_vname, const Message& proto,
                       const TextFormat::ParseInfoTree& parse_tree,
                       const FieldDescriptor& field, int field_index);
 
+  // Adds an anchor for the field name at `loc` and a "ref" edge from it to
+  // `field`.
+  Status AddFieldReference(const proto::VName& file_vname,
+                           const FieldDescriptor& field,
+                           TextFormat::ParseLocation loc);
+
+  // Streams fields of a message of type `descriptor` (null if unknown) from
+  // `tokenizer` until `delimiter` is consumed, or until the end of input if
+  // `delimiter` is empty.
+  Status StreamFields(const proto::VName& file_vname,
+                      const Descriptor* descriptor, absl::string_view delimiter,
+                      int depth, google::protobuf::io::Tokenizer* tokenizer);
+
+  // Streams a single "name: value" field of a message of type `descriptor`.
+  Status StreamField(const proto::VName& file_vname,
+                     const Descriptor* descriptor, int depth,
+                     google::protobuf::io::Tokenizer* tokenizer);
+
+  // Streams a field value, which is a message of type `message_type` if it is
+  // delimited by braces. Unknown message types are passed as null.
+  Status StreamFieldValue(const proto::VName& file_vname,
+                          const Descriptor* message_type, int depth,
+                          google::protobuf::io::Tokenizer* tokenizer);
+
   proto::VName CreateAndAddAnchorNode(const proto::VName& file,
                                       const FieldDescriptor& field,
                                       TextFormat::ParseLocation loc);
 
-  absl::optional<proto::VName> VNameForRelPath(
-      absl::string_view simplified_path) const;
+  // Returns the singular, non-message fields of `descriptor` that have no
+  // presence tracking (proto3 scalars outside a oneof). These are absent from
+  // Reflection::ListFields() when the textproto sets them to their default
+  // value, so they must be checked against the ParseInfoTree directly.
+  const std::vector<const FieldDescriptor*>& ImplicitPresenceFields(
+      const Descriptor& descriptor);
 
-  const proto::CompilationUnit* unit_;
   KytheGraphRecorder* recorder_;
   const UTF8LineIndex line_index_;
 
-  // Proto search paths are used to resolve relative paths to full paths.
-  const absl::flat_hash_map<std::string, std::string>* file_substitution_cache_;
-};
+  // The VNames of fields, shared by the textprotos of the unit.
+  FieldVNameCache* field_vnames_;
 
-absl::optional<proto::VName> TextprotoAnalyzer::VNameForRelPath(
-    absl::string_view simplified_path) const {
-  absl::string_view full_path;
-  auto it = file_substitution_cache_->find(simplified_path);
-  if (it != file_substitution_cache_->end()) {
-    full_path = it->second;
-  } else {
-    full_path = simplified_path;
-  }
-  return LookupVNameForFullPath(full_path, *unit_);
-}
+  // Memoized results of ImplicitPresenceFields().
+  absl::flat_hash_map<const Descriptor*, std::vector<const FieldDescriptor*>>
+      implicit_presence_fields_;
+};
 
 Status TextprotoAnalyzer::AnalyzeMessage(
     const proto::VName& file_vname, const Message& proto,
     const Descriptor& descriptor, const TextFormat::ParseInfoTree& parse_tree) {
   const Reflection* reflection = proto.GetReflection();
 
-  // Iterate across all fields in the message. For proto1 and 2, each field has
-  // a bit that tracks whether or not each field was set. This could be used to
-  // only look at fields we know are set (with reflection.ListFields()). Proto3
-  // however does not have "has" bits, so this approach would not work, thus we
-  // look at every field.
-  for (int field_index = 0; field_index < descriptor.field_count();
-       field_index++) {
-    const FieldDescriptor& field = *descriptor.field(field_index);
-    if (field.is_repeated()) {
-      // Handle repeated field.
-      const int count = reflection->FieldSize(proto, &field);
-      if (count == 0) {
-        continue;
-      }
-
+  // Visit the fields and extensions the parser set in the message, so that
+  // the work done scales with the input rather than with the schema.
+  // ParseInfoTree does not expose the fields it recorded locations for, but
+  // every field it saw was also set on the message.
+  std::vector<const FieldDescriptor*> set_fields;
+  reflection->ListFields(proto, &set_fields);
+  for (const FieldDescriptor* field : set_fields) {
+    if (field->is_repeated()) {
       // Add a ref for each instance of the repeated field.
+      const int count = reflection->FieldSize(proto, field);
       for (int i = 0; i < count; i++) {
-        auto s = AnalyzeField(file_vname, proto, parse_tree, field, i);
+        auto s = AnalyzeField(file_vname, proto, parse_tree, *field, i);
         if (!s.ok()) return s;
       }
     } else {
-      auto s = AnalyzeField(file_vname, proto, parse_tree, field,
+      auto s = AnalyzeField(file_vname, proto, parse_tree, *field,
                             kNonRepeatedFieldIndex);
       if (!s.ok()) return s;
     }
   }
 
-  // Determine what extensions are present in the parsed proto and analyze them.
-  std::vector<const FieldDescriptor*> set_fields;
-  reflection->ListFields(proto, &set_fields);
-  for (const FieldDescriptor* field : set_fields) {
-    // Non-extensions are already handled above.
-    if (!field->is_extension()) {
-      continue;
+  // Proto3 has no "has" bits for scalars, so a scalar explicitly set to its
+  // default value in the input is not listed above. Check those separately.
+  for (const FieldDescriptor* field : ImplicitPresenceFields(descriptor)) {
+    if (reflection->HasField(proto, field)) {
+      continue;  // Already handled above.
     }
-
     auto s = AnalyzeField(file_vname, proto, parse_tree, *field,
                           kNonRepeatedFieldIndex);
     if (!s.ok()) return s;
@@ -182,6 +341,25 @@ Status TextprotoAnalyzer::AnalyzeMessage(
   return OkStatus();
 }
 
+const std::vector<const FieldDescriptor*>&
+TextprotoAnalyzer::ImplicitPresenceFields(const Descriptor& descriptor) {
+  auto inserted = implicit_presence_fields_.emplace(
+      &descriptor, std::vector<const FieldDescriptor*>());
+  std::vector<const FieldDescriptor*>& fields = inserted.first->second;
+  if (inserted.second &&
+      descriptor.file()->syntax() == FileDescriptor::SYNTAX_PROTO3) {
+    for (int i = 0; i < descriptor.field_count(); i++) {
+      const FieldDescriptor* field = descriptor.field(i);
+      if (!field->is_repeated() &&
+          field->cpp_type() != FieldDescriptor::CPPTYPE_MESSAGE &&
+          field->containing_oneof() == nullptr) {
+        fields.push_back(field);
+      }
+    }
+  }
+  return fields;
+}
+
 Status TextprotoAnalyzer::AnalyzeField(
     const proto::VName& file_vname, const Message& proto,
     const TextFormat::ParseInfoTree& parse_tree, const FieldDescriptor& field,
@@ -204,23 +382,8 @@ Status TextprotoAnalyzer::AnalyzeField(
     return OkStatus();
   }
 
-  proto::VName anchor_vname = CreateAndAddAnchorNode(file_vname, field, loc);
-
-  // Add ref to proto field.
-  Status vname_lookup_status = OkStatus();
-  proto::VName field_vname = ::kythe::lang_proto::VNameForDescriptor(
-      &field, [this, &vname_lookup_status](const std::string& path) {
-        auto v = VNameForRelPath(path);
-        if (!v.has_value()) {
-          vname_lookup_status = UnknownError(
-              absl::StrCat("Unable to lookup vname for rel path: ", path));
-          return proto::VName();
-        }
-        return *v;
-      });
-  if (!vname_lookup_status.ok()) return vname_lookup_status;
-  recorder_->AddEdge(VNameRef(anchor_vname), EdgeKindID::kRef,
-                     VNameRef(field_vname));
+  Status ref_status = AddFieldReference(file_vname, field, loc);
+  if (!ref_status.ok()) return ref_status;
 
   // Handle submessage.
   if (field.type() == FieldDescriptor::TYPE_MESSAGE) {
@@ -239,6 +402,165 @@ Status TextprotoAnalyzer::AnalyzeField(
   return OkStatus();
 }
 
+Status TextprotoAnalyzer::AddFieldReference(const proto::VName& file_vname,
+                                            const FieldDescriptor& field,
+                                            TextFormat::ParseLocation loc) {
+  proto::VName anchor_vname = CreateAndAddAnchorNode(file_vname, field, loc);
+
+  // Add ref to proto field.
+  const VNameRef* field_vname = nullptr;
+  Status vname_lookup_status = field_vnames_->Lookup(field, &field_vname);
+  if (!vname_lookup_status.ok()) return vname_lookup_status;
+  recorder_->AddEdge(VNameRef(anchor_vname), EdgeKindID::kRef, *field_vname);
+  return OkStatus();
+}
+
+Status TextprotoAnalyzer::AnalyzeTokens(const proto::VName& file_vname,
+                                        const Descriptor& descriptor,
+                                        absl::string_view textproto) {
+  google::protobuf::io::ArrayInputStream input(textproto.data(),
+                                               textproto.size());
+  TokenizerErrorCollector errors;
+  Tokenizer tokenizer(&input, &errors);
+  // Match the tokenizer configuration used by TextFormat::Parser.
+  tokenizer.set_allow_f_after_float(true);
+  tokenizer.set_comment_style(Tokenizer::SH_COMMENT_STYLE);
+  tokenizer.set_require_space_after_number(false);
+  tokenizer.set_allow_multiline_strings(true);
+  tokenizer.Next();
+
+  Status status = StreamFields(file_vname, &descriptor, "", 0, &tokenizer);
+  if (status.ok() && !errors.error().empty()) {
+    status = UnknownError(
+        absl::StrCat("Failed to tokenize text proto: ", errors.error()));
+  }
+  return status;
+}
+
+Status TextprotoAnalyzer::StreamFields(const proto::VName& file_vname,
+                                       const Descriptor* descriptor,
+                                       absl::string_view delimiter, int depth,
+                                       Tokenizer* tokenizer) {
+  while (!TryConsume(tokenizer, delimiter)) {
+    if (tokenizer->current().type == Tokenizer::TYPE_END) {
+      if (delimiter.empty()) {
+        return OkStatus();
+      }
+      return UnknownError(absl::StrCat("Expected \"", delimiter,
+                                       "\" before end of text proto"));
+    }
+    auto s = StreamField(file_vname, descriptor, depth, tokenizer);
+    if (!s.ok()) return s;
+    // Fields may optionally be separated by ';' or ','.
+    if (!TryConsume(tokenizer, ";")) {
+      TryConsume(tokenizer, ",");
+    }
+  }
+  return OkStatus();
+}
+
+Status TextprotoAnalyzer::StreamField(const proto::VName& file_vname,
+                                      const Descriptor* descriptor, int depth,
+                                      Tokenizer* tokenizer) {
+  TextFormat::ParseLocation loc(tokenizer->current().line + 1,
+                                tokenizer->current().column);
+  const FieldDescriptor* field = nullptr;
+  if (TryConsume(tokenizer, "[")) {
+    // An extension, or the type URL of an expanded Any. Fields inside an
+    // expanded Any are not indexed, so its contents are only skipped over.
+    std::string name;
+    while (!TryConsume(tokenizer, "]")) {
+      const Tokenizer::Token& token = tokenizer->current();
+      if (token.type != Tokenizer::TYPE_IDENTIFIER && token.text != "." &&
+          token.text != "/") {
+        return UnknownError(absl::StrCat("Unexpected \"", token.text,
+                                         "\" in extension name at line ",
+                                         token.line + 1));
+      }
+      name += token.text;
+      tokenizer->Next();
+    }
+    if (descriptor != nullptr && !absl::StrContains(name, "/")) {
+      field = descriptor->file()->pool()->FindExtensionByPrintableName(
+          descriptor, name);
+    }
+  } else {
+    const Tokenizer::Token& token = tokenizer->current();
+    if (token.type != Tokenizer::TYPE_IDENTIFIER) {
+      return UnknownError(absl::StrCat("Expected field name, got \"",
+                                       token.text, "\" at line ",
+                                       token.line + 1));
+    }
+    if (descriptor != nullptr) {
+      field = FindFieldByTextName(*descriptor, token.text);
+    }
+    tokenizer->Next();
+  }
+
+  const Descriptor* message_type = nullptr;
+  if (field != nullptr) {
+    auto s = AddFieldReference(file_vname, *field, loc);
+    if (!s.ok()) return s;
+    message_type = field->message_type();
+  }
+
+  TryConsume(tokenizer, ":");
+  return StreamFieldValue(file_vname, message_type, depth, tokenizer);
+}
+
+Status TextprotoAnalyzer::StreamFieldValue(const proto::VName& file_vname,
+                                           const Descriptor* message_type,
+                                           int depth, Tokenizer* tokenizer) {
+  // Every nested message or list passes through here, so this bounds the
+  // recursion whatever the input.
+  if (depth > kMaxStreamingDepth) {
+    return UnknownError("Text proto nesting exceeds the maximum depth");
+  }
+  if (TryConsume(tokenizer, "[")) {
+    // A list of values for a repeated field.
+    if (TryConsume(tokenizer, "]")) {
+      return OkStatus();
+    }
+    do {
+      auto s =
+          StreamFieldValue(file_vname, message_type, depth + 1, tokenizer);
+      if (!s.ok()) return s;
+    } while (TryConsume(tokenizer, ","));
+    if (!TryConsume(tokenizer, "]")) {
+      return UnknownError(absl::StrCat("Expected \"]\" at line ",
+                                       tokenizer->current().line + 1));
+    }
+    return OkStatus();
+  }
+  if (TryConsume(tokenizer, "{")) {
+    return StreamFields(file_vname, message_type, "}", depth + 1, tokenizer);
+  }
+  if (TryConsume(tokenizer, "<")) {
+    return StreamFields(file_vname, message_type, ">", depth + 1, tokenizer);
+  }
+
+  // A scalar value: a possibly-negated number or identifier, or a sequence of
+  // adjacent strings.
+  TryConsume(tokenizer, "-");
+  switch (tokenizer->current().type) {
+    case Tokenizer::TYPE_IDENTIFIER:
+    case Tokenizer::TYPE_INTEGER:
+    case Tokenizer::TYPE_FLOAT:
+      tokenizer->Next();
+      return OkStatus();
+    case Tokenizer::TYPE_STRING:
+      while (tokenizer->current().type == Tokenizer::TYPE_STRING) {
+        tokenizer->Next();
+      }
+      return OkStatus();
+    default:
+      return UnknownError(absl::StrCat("Expected field value, got \"",
+                                       tokenizer->current().text,
+                                       "\" at line ",
+                                       tokenizer->current().line + 1));
+  }
+}
+
 proto::VName TextprotoAnalyzer::CreateAndAddAnchorNode(
     const proto::VName& file_vname, const FieldDescriptor& field,
     TextFormat::ParseLocation loc) {
@@ -279,106 +601,193 @@ absl::optional<std::string> ParseProtoMessageArg(
   return absl::nullopt;
 }
 
+// Finds the arguments after each --proto_message_for, which are of the form
+// <textproto path>=<message name>, and returns the message of each textproto.
+// Removes the flags and arguments from @args. Returns nullopt if some
+// argument is malformed.
+absl::optional<absl::flat_hash_map<std::string, std::string>>
+ParseProtoMessageForArgs(std::vector<std::string>* args) {
+  absl::flat_hash_map<std::string, std::string> messages;
+  for (size_t i = 0; i < args->size();) {
+    if (args->at(i) != "--proto_message_for") {
+      ++i;
+      continue;
+    }
+    if (i + 1 >= args->size()) {
+      return absl::nullopt;
+    }
+    // Message names can't contain '=', so the last one ends the path.
+    const std::string& mapping = args->at(i + 1);
+    size_t separator = mapping.rfind('=');
+    if (separator == std::string::npos || separator == 0) {
+      return absl::nullopt;
+    }
+    messages[mapping.substr(0, separator)] = mapping.substr(separator + 1);
+    args->erase(args->begin() + i, args->begin() + i + 2);
+  }
+  return messages;
+}
+
 /// Given a full file path, returns a path relative to a directory in the
 /// current search path. If the mapping isn't already in the cache, it is added.
 /// \param full_path Full path to proto file
-/// \param path_substitutions A map of (virtual directory, real directory) pairs
-/// \param file_substitution_cache A map of (fullpath, relpath) pairs
+/// \param search_path An index of the (virtual directory, real directory)
+/// path substitutions
+/// \param file_substitution_cache The (relpath, fullpath) pairs seen so far
 std::string FullPathToRelative(
     const absl::string_view full_path,
-    const std::vector<std::pair<std::string, std::string>>& path_substitutions,
-    absl::flat_hash_map<std::string, std::string>* file_substitution_cache) {
+    const lang_proto::SearchPathIndex& search_path,
+    PathSubstitutionCache* file_substitution_cache) {
   // If the SourceTree has opened this path already, its entry will be in the
   // cache.
-  for (const auto& sub : *file_substitution_cache) {
-    if (sub.second == full_path) {
-      return sub.first;
-    }
+  if (const std::string* relpath =
+          file_substitution_cache->FindRelativePath(full_path)) {
+    return *relpath;
   }
 
-  // Look through substitutions for a directory mapping that contains the given
+  // Look for the first search path directory that contains the given
   // full_path.
   // TODO(justbuchanan): consider using the *longest* match, not just the
   // first one.
-  for (auto& sub : path_substitutions) {
-    std::string dir = sub.second;
-    if (!absl::EndsWith(dir, "/")) {
-      dir += "/";
-    }
-
-    // If this substitution matches, apply it and return the simplified path.
-    absl::string_view relpath = full_path;
-    if (ConsumePrefix(&relpath, dir)) {
-      std::string result = sub.first.empty() ? std::string(relpath)
-                                             : JoinPath(sub.first, relpath);
-      (*file_substitution_cache)[result] = std::string(full_path);
-      return result;
-    }
+  absl::optional<std::string> relpath = search_path.RelativePath(full_path);
+  if (relpath.has_value()) {
+    file_substitution_cache->Insert(*relpath, full_path);
+    return *std::move(relpath);
   }
 
   return std::string(full_path);
 }
 
-}  // anonymous namespace
-
-Status AnalyzeCompilationUnit(const proto::CompilationUnit& unit,
-                              const std::vector<proto::FileData>& files,
-                              KytheGraphRecorder* recorder) {
-  if (unit.source_file().size() != 1) {
-    return FailedPreconditionError("Expected Unit to contain 1 source file");
-  }
-  if (files.size() < 2) {
-    return FailedPreconditionError(
-        "Must provide at least 2 files: a textproto and 1+ .proto files");
+// The descriptor pool and message factory built from the proto files of a
+// compilation unit, along with the state needed to keep them valid.
+struct Schema {
+  Schema(std::vector<std::pair<std::string, std::string>> substitutions,
+         const std::string& parse_cache_dir)
+      : path_substitutions(std::move(substitutions)),
+        file_reader(&path_substitutions, &file_substitution_cache),
+        source_tree_db(&file_reader),
+        parse_cache_db(
+            parse_cache_dir,
+            [this](const std::string& filename) { return Digest(filename); },
+            &source_tree_db),
+        well_known_types_db(
+            [this](const std::string& filename) { return Digest(filename); },
+            &parse_cache_db),
+        descriptor_pool(&well_known_types_db,
+                        source_tree_db.GetValidationErrorCollector()) {
+    source_tree_db.RecordErrorsTo(&error_collector);
+    descriptor_pool.EnforceWeakDependencies(true);
   }
 
-  const std::string textproto_name = unit.source_file(0);
+  const DescriptorPool* pool() const { return &descriptor_pool; }
+
+  // Returns the digest of the file an import of `filename` resolves to, or an
+  // empty string if there is no such file or it has no digest.
+  std::string Digest(const std::string& filename) {
+    absl::optional<std::string> full_path = file_reader.Resolve(filename);
+    if (!full_path.has_value()) {
+      return "";
+    }
+    auto found = file_digests.find(*full_path);
+    return found != file_digests.end() ? found->second : "";
+  }
 
-  // Parse path substitutions from arguments.
-  absl::flat_hash_map<std::string, std::string> file_substitution_cache;
   std::vector<std::pair<std::string, std::string>> path_substitutions;
-  std::vector<std::string> args;
-  ::kythe::lang_proto::ParsePathSubstitutions(unit.argument(),
-                                              &path_substitutions, &args);
+  PathSubstitutionCache file_substitution_cache;
+  PreloadedProtoFileTree file_reader;
+  // Full path -> digest, for the proto files that have one.
+  absl::flat_hash_map<std::string, std::string> file_digests;
+  LoggingMultiFileErrorCollector error_collector;
+  google::protobuf::compiler::SourceTreeDescriptorDatabase source_tree_db;
+  CachingDescriptorDatabase parse_cache_db;
+  WellKnownTypesDatabase well_known_types_db;
+  DescriptorPool descriptor_pool;
+  google::protobuf::DynamicMessageFactory msg_factory;
+};
 
-  // Find --proto_message in args.
-  std::string message_name;
-  {
-    auto opt_message_name = ParseProtoMessageArg(&args);
-    if (!opt_message_name.has_value()) {
-      return UnknownError(
-          "Compilation unit arguments must specify --proto_message");
+// Maximum number of schemas kept alive by GetSchema().
+constexpr size_t kMaxCachedSchemas = 64;
+
+// Process-wide cache of schemas, keyed by the search path and the sorted
+// (path, digest) pairs of the proto files they were built from. Units may be
+// analyzed on several threads; cached schemas are only read once built.
+struct SchemaCache {
+  // Guards the members below. Schemas are built without holding it.
+  std::mutex mu;
+  absl::flat_hash_map<std::string, std::shared_ptr<Schema>> schemas;
+  // Cache keys in insertion order, used for eviction.
+  std::deque<std::string> keys;
+};
+
+SchemaCache* GetSchemaCache() {
+  static SchemaCache* cache = new SchemaCache();
+  return cache;
+}
+
+// The paths of the textprotos of a compilation unit.
+using TextprotoNames = absl::flat_hash_set<absl::string_view>;
+
+// Returns a cache key for the schema built from `files` (less the textprotos)
+// with `path_substitutions`, or nullopt if some file lacks a digest.
+absl::optional<std::string> SchemaCacheKey(
+    const std::vector<std::pair<std::string, std::string>>& path_substitutions,
+    const std::vector<proto::FileData>& files,
+    const TextprotoNames& textproto_names) {
+  std::vector<std::pair<absl::string_view, absl::string_view>> inputs;
+  for (const auto& file : files) {
+    if (textproto_names.contains(file.info().path())) {
+      continue;
     }
-    message_name = *opt_message_name;
+    if (file.info().digest().empty()) {
+      return absl::nullopt;
+    }
+    inputs.emplace_back(file.info().path(), file.info().digest());
+  }
+  std::sort(inputs.begin(), inputs.end());
+  std::string key;
+  for (const auto& sub : path_substitutions) {
+    absl::StrAppend(&key, sub.first, "=", sub.second, "\n");
   }
-  LOG(INFO) << "Proto message name: " << message_name;
+  absl::StrAppend(&key, "\n");
+  for (const auto& input : inputs) {
+    absl::StrAppend(&key, input.first, " ", input.second, "\n");
+  }
+  return key;
+}
 
-  // Load all proto files into in-memory SourceTree.
-  PreloadedProtoFileTree file_reader(&path_substitutions,
-                                     &file_substitution_cache);
+// Builds a descriptor pool from all proto files in `files` (that is, all
+// files except the textprotos).
+//
+// Every proto file is loaded here, and the databases behind the pool can't
+// search for symbols, so later lookups never reach the source tree. The
+// finished schema can therefore be used from several threads at once.
+Status BuildSchema(
+    const std::vector<std::pair<std::string, std::string>>& path_substitutions,
+    const std::vector<proto::FileData>& files,
+    const TextprotoNames& textproto_names, const std::string& parse_cache_dir,
+    std::shared_ptr<Schema>* schema_out) {
+  auto schema = std::make_shared<Schema>(path_substitutions, parse_cache_dir);
+
+  // Load all proto files into in-memory SourceTree. The contents are copied
+  // since the schema may outlive `files`.
   std::vector<std::string> proto_filenames;
-  const proto::FileData* textproto_file_data = nullptr;
   for (const auto& file : files) {
-    // Skip textproto - only proto files go in the descriptor db.
-    if (file.info().path() == textproto_name) {
-      textproto_file_data = &file;
+    // Skip textprotos - only proto files go in the descriptor db.
+    if (textproto_names.contains(file.info().path())) {
       continue;
     }
 
     LOG(INFO) << "Added file to descriptor db: " << file.info().path();
-    if (!file_reader.AddFile(file.info().path(), file.content())) {
+    if (!schema->file_reader.AddFile(file.info().path(), file.content())) {
       return UnknownError("Unable to add file to SourceTree.");
     }
+    if (!file.info().digest().empty()) {
+      schema->file_digests.emplace(file.info().path(), file.info().digest());
+    }
     proto_filenames.push_back(file.info().path());
   }
-  if (textproto_file_data == nullptr) {
-    return NotFoundError("Couldn't find textproto source in file data.");
-  }
 
   // Build proto descriptor pool with top-level protos.
-  LoggingMultiFileErrorCollector error_collector;
-  google::protobuf::compiler::Importer proto_importer(&file_reader,
-                                                      &error_collector);
   for (const std::string& fname : proto_filenames) {
     // The proto importer gets confused if the same proto file is Import()'d
     // under two different file paths. For example, if subdir/some.proto is
@@ -388,27 +797,95 @@ Status AnalyzeCompilationUnit(const proto::CompilationUnit& unit,
     // "import" statements in proto files are also relative to the proto
     // compiler search path. This ensures that the importer doesn't see the same
     // file twice under two different names.
-    std::string relpath =
-        FullPathToRelative(fname, path_substitutions, &file_substitution_cache);
-    if (!proto_importer.Import(relpath)) {
+    std::string relpath = FullPathToRelative(
+        fname, schema->file_reader.search_path(),
+        &schema->file_substitution_cache);
+    if (schema->descriptor_pool.FindFileByName(relpath) == nullptr) {
       return UnknownError("Error importing proto file: " + relpath);
     }
     LOG(INFO) << "Added proto to descriptor pool: " << relpath;
   }
-  const DescriptorPool* descriptor_pool = proto_importer.pool();
 
-  // Get a descriptor for the top-level Message.
-  const Descriptor* descriptor =
-      descriptor_pool->FindMessageTypeByName(message_name);
-  if (descriptor == nullptr) {
-    return NotFoundError(absl::StrCat(
-        "Unable to find proto message in descriptor pool: ", message_name));
+  *schema_out = std::move(schema);
+  return OkStatus();
+}
+
+// Returns the schema for the proto files in `files`, reusing a previously
+// built one when a unit with the same proto inputs and search path has
+// already been analyzed.
+Status GetSchema(
+    const std::vector<std::pair<std::string, std::string>>& path_substitutions,
+    const std::vector<proto::FileData>& files,
+    const TextprotoNames& textproto_names, const std::string& parse_cache_dir,
+    std::shared_ptr<Schema>* schema) {
+  absl::optional<std::string> key =
+      SchemaCacheKey(path_substitutions, files, textproto_names);
+  if (!key.has_value()) {
+    return BuildSchema(path_substitutions, files, textproto_names,
+                       parse_cache_dir, schema);
+  }
+
+  SchemaCache* cache = GetSchemaCache();
+  {
+    std::lock_guard<std::mutex> lock(cache->mu);
+    auto found = cache->schemas.find(*key);
+    if (found != cache->schemas.end()) {
+      *schema = found->second;
+      return OkStatus();
+    }
+  }
+
+  Status status = BuildSchema(path_substitutions, files, textproto_names,
+                              parse_cache_dir, schema);
+  if (!status.ok()) return status;
+  std::lock_guard<std::mutex> lock(cache->mu);
+  // Another thread may have built the same schema meanwhile; keep the first.
+  auto inserted = cache->schemas.emplace(*key, *schema);
+  if (!inserted.second) {
+    *schema = inserted.first->second;
+    return OkStatus();
+  }
+  if (cache->keys.size() >= kMaxCachedSchemas) {
+    cache->schemas.erase(cache->keys.front());
+    cache->keys.pop_front();
+  }
+  cache->keys.push_back(*std::move(key));
+  return OkStatus();
+}
+
+// Analyzes the textproto `textproto_name`, with contents `content` and schema
+// `descriptor` from `schema`, and writes its graph to `output`. Field VNames
+// are looked up in `field_vnames`, which is shared by the unit's textprotos.
+Status AnalyzeTextproto(const proto::CompilationUnit& unit,
+                        const Schema& schema,
+                        const std::string& textproto_name,
+                        const std::string& content,
+                        const Descriptor& descriptor,
+                        const AnalyzeOptions& options,
+                        FieldVNameCache* field_vnames,
+                        KytheOutputStream* output) {
+  absl::optional<proto::VName> file_vname =
+      LookupVNameForFullPath(textproto_name, unit);
+  if (!file_vname.has_value()) {
+    return UnknownError(
+        absl::StrCat("Unable to find vname for textproto: ", textproto_name));
+  }
+
+  KytheGraphRecorder recorder(output);
+  TextprotoAnalyzer analyzer(content, field_vnames, &recorder);
+
+  if (options.streaming) {
+    // Emit file node.
+    recorder.AddProperty(VNameRef(*file_vname), NodeKindID::kFile);
+    // Record source text as a fact.
+    recorder.AddProperty(VNameRef(*file_vname), PropertyID::kText, content);
+    return analyzer.AnalyzeTokens(*file_vname, descriptor, content);
   }
 
   // Use reflection to create an instance of the top-level proto message.
-  // note: msg_factory must outlive any protos created from it.
-  google::protobuf::DynamicMessageFactory msg_factory;
-  std::unique_ptr<Message> proto(msg_factory.GetPrototype(descriptor)->New());
+  // note: the schema's msg_factory must outlive any protos created from it.
+  std::unique_ptr<Message> proto(
+      schema.msg_factory.GetPrototype(&descriptor)->New());
 
   // Parse textproto into @proto, recording input locations to @parse_tree.
   TextFormat::ParseInfoTree parse_tree;
@@ -419,27 +896,159 @@ Status AnalyzeCompilationUnit(const proto::CompilationUnit& unit,
     // we'd like to analyze the parts that are good.
     parser.AllowPartialMessage(true);
     parser.AllowUnknownExtension(true);
-    if (!parser.ParseFromString(textproto_file_data->content(), proto.get())) {
+    if (!parser.ParseFromString(content, proto.get())) {
       return UnknownError("Failed to parse text proto");
     }
   }
 
   // Emit file node.
-  absl::optional<proto::VName> file_vname =
-      LookupVNameForFullPath(textproto_name, unit);
-  if (!file_vname.has_value()) {
-    return UnknownError(
-        absl::StrCat("Unable to find vname for textproto: ", textproto_name));
-  }
-  recorder->AddProperty(VNameRef(*file_vname), NodeKindID::kFile);
+  recorder.AddProperty(VNameRef(*file_vname), NodeKindID::kFile);
   // Record source text as a fact.
-  recorder->AddProperty(VNameRef(*file_vname), PropertyID::kText,
-                        textproto_file_data->content());
+  recorder.AddProperty(VNameRef(*file_vname), PropertyID::kText, content);
 
   // Analyze!
-  TextprotoAnalyzer analyzer(&unit, textproto_file_data->content(),
-                             &file_substitution_cache, recorder);
-  return analyzer.AnalyzeMessage(*file_vname, *proto, *descriptor, parse_tree);
+  return analyzer.AnalyzeMessage(*file_vname, *proto, descriptor, parse_tree);
+}
+
+}  // anonymous namespace
+
+Status AnalyzeCompilationUnit(const proto::CompilationUnit& unit,
+                              const std::vector<proto::FileData>& files,
+                              KytheOutputStream* output,
+                              const AnalyzeOptions& options) {
+  if (unit.source_file().empty()) {
+    return FailedPreconditionError(
+        "Expected Unit to contain 1+ source files");
+  }
+  TextprotoNames textproto_names(unit.source_file().begin(),
+                                 unit.source_file().end());
+  if (files.size() < textproto_names.size() + 1) {
+    return FailedPreconditionError(absl::StrCat(
+        "Must provide at least ", textproto_names.size() + 1,
+        " files: one per source textproto (", textproto_names.size(),
+        ") and 1+ .proto files, but got ", files.size()));
+  }
+
+  // Parse path substitutions from arguments.
+  std::vector<std::pair<std::string, std::string>> path_substitutions;
+  std::vector<std::string> args;
+  ::kythe::lang_proto::ParsePathSubstitutions(unit.argument(),
+                                              &path_substitutions, &args);
+
+  // Find --proto_message and any --proto_message_for in args.
+  absl::optional<std::string> default_message = ParseProtoMessageArg(&args);
+  auto file_messages = ParseProtoMessageForArgs(&args);
+  if (!file_messages.has_value()) {
+    return InvalidArgumentError(
+        "--proto_message_for expects an argument of the form "
+        "<textproto>=<message>");
+  }
+
+  // The textprotos to analyze, in source file order, with their messages.
+  struct Textproto {
+    const std::string* name;
+    const proto::FileData* file_data = nullptr;
+    std::string message_name;
+    const Descriptor* descriptor = nullptr;
+  };
+  std::vector<Textproto> textprotos;
+  absl::flat_hash_map<absl::string_view, size_t> textproto_indices;
+  for (const std::string& textproto_name : unit.source_file()) {
+    if (!textproto_indices.emplace(textproto_name, textprotos.size()).second) {
+      continue;  // Each textproto is analyzed once.
+    }
+    Textproto textproto;
+    textproto.name = &textproto_name;
+    auto message = file_messages->find(textproto_name);
+    if (message != file_messages->end()) {
+      textproto.message_name = message->second;
+    } else if (default_message.has_value()) {
+      textproto.message_name = *default_message;
+    } else {
+      return UnknownError(absl::StrCat(
+          "Compilation unit arguments must specify --proto_message or "
+          "--proto_message_for for ",
+          textproto_name));
+    }
+    LOG(INFO) << "Proto message name for " << textproto_name << ": "
+              << textproto.message_name;
+    textprotos.push_back(std::move(textproto));
+  }
+
+  for (const auto& file : files) {
+    auto found = textproto_indices.find(file.info().path());
+    if (found != textproto_indices.end() &&
+        textprotos[found->second].file_data == nullptr) {
+      textprotos[found->second].file_data = &file;
+    }
+  }
+
+  std::shared_ptr<Schema> schema;
+  Status schema_status = GetSchema(path_substitutions, files, textproto_names,
+                                   options.parse_cache_dir, &schema);
+  if (!schema_status.ok()) return schema_status;
+
+  // Get a descriptor for the top-level Message of each textproto.
+  for (Textproto& textproto : textprotos) {
+    if (textproto.file_data == nullptr) {
+      return NotFoundError(absl::StrCat(
+          "Couldn't find textproto source in file data: ", *textproto.name));
+    }
+    textproto.descriptor =
+        schema->pool()->FindMessageTypeByName(textproto.message_name);
+    if (textproto.descriptor == nullptr) {
+      return NotFoundError(
+          absl::StrCat("Unable to find proto message in descriptor pool: ",
+                       textproto.message_name));
+    }
+  }
+
+  FieldVNameCache field_vnames(&unit, &schema->file_substitution_cache);
+  auto analyze = [&](const Textproto& textproto, KytheOutputStream* out) {
+    return AnalyzeTextproto(unit, *schema, *textproto.name,
+                            textproto.file_data->content(),
+                            *textproto.descriptor, options, &field_vnames, out);
+  };
+  if (options.threads <= 1 || textprotos.size() == 1) {
+    for (const Textproto& textproto : textprotos) {
+      Status status = analyze(textproto, output);
+      if (!status.ok()) return status;
+    }
+    return OkStatus();
+  }
+
+  // Analyze the textprotos on up to `options.threads` threads, sharing the
+  // schema. Each textproto's output is buffered and written in source file
+  // order, so the result does not depend on scheduling.
+  struct Result {
+    Status status;
+    std::vector<proto::Entry> entries;
+  };
+  std::vector<Result> results(textprotos.size());
+  std::atomic<size_t> next_textproto(0);
+  auto analyze_textprotos = [&] {
+    BufferedOutputStream buffer;
+    for (size_t i = next_textproto++; i < textprotos.size();
+         i = next_textproto++) {
+      results[i].status = analyze(textprotos[i], &buffer);
+      results[i].entries = buffer.TakeEntries();
+    }
+  };
+  std::vector<std::thread> workers;
+  for (size_t i = 0;
+       i < std::min<size_t>(options.threads, textprotos.size()); ++i) {
+    workers.emplace_back(analyze_textprotos);
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  // Like the serial path, stop at the first textproto that fails.
+  for (const Result& result : results) {
+    EmitEntries(result.entries, output);
+    if (!result.status.ok()) return result.status;
+  }
+  return OkStatus();
 }
 
 }  // namespace lang_textproto
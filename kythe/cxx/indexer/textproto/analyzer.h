@@ -20,7 +20,7 @@
 #include <cstdio>
 #include <string>
 #include "kythe/cxx/common/file_vname_generator.h"
-#include "kythe/cxx/common/indexing/KytheGraphRecorder.h"
+#include "kythe/cxx/common/indexing/KytheOutputStream.h"
 #include "kythe/cxx/common/status.h"
 #include "kythe/proto/analysis.pb.h"
 
@@ -30,29 +30,59 @@ namespace lang_textproto {
 // The canonical name for the textproto language in Kythe.
 extern const absl::string_view kLanguageName;
 
-/// Analyzes the textproto file described by @unit and emits graph facts to
-/// @recorder.
+// Options controlling how a textproto is analyzed.
+struct AnalyzeOptions {
+  // Index fields directly from the token stream rather than parsing the
+  // textproto into a message first. This keeps memory use independent of the
+  // size of the textproto, at the cost of the parser's validation.
+  bool streaming = false;
+
+  // A directory, shared between indexer processes, in which parsed proto
+  // files are cached by content. Empty to parse every file.
+  std::string parse_cache_dir;
+
+  // The number of threads used to analyze the textprotos of a compilation
+  // unit. Output is the same for any value.
+  int threads = 1;
+};
+
+/// Analyzes the textproto files described by @unit and emits graph facts to
+/// @output.
 ///
 /// The basic indexing flow is as follows:
-/// * Build a DescriptorPool from all protos in the compilation unit.
-/// * Find the descriptor for the textproto's main message by name.
+/// * Build a DescriptorPool from all protos in the compilation unit. Pools
+///   are cached for the life of the process and reused by later units with
+///   the same proto inputs (by path and digest) and search path. With
+///   AnalyzeOptions::parse_cache_dir set, parsed protos are also shared
+///   between processes through that directory.
+/// * Find the descriptor for each textproto's main message by name.
 /// * Construct an empty message instance from the descriptor.
 /// * Parse the textproto into our empty message using TextFormat::Parser with
 ///   locations recorded to a ParseInfoTree. The parser uses the DescriptorPool
 ///   to lookup field descriptors and extensions.
-/// * For each field in the descriptor, see if the ParseInfoTree saw one in the
-///   input. If so, add an anchor node and associate it with the proto
-///   descriptor with a “ref” edge.
+/// * For each field set in the parsed message (plus any proto3 scalars the
+///   ParseInfoTree saw set to their default value), add an anchor node and
+///   associate it with the proto descriptor with a “ref” edge.
 /// * Repeat the above step recursively for any fields that are messages.
 ///
-/// \param unit The compilation unit specifying the textproto and the
-/// protos that define its schema.
-/// \param file_data The file contents of the textproto and relevant protos.
-/// \param The name of the message type that defines the schema for the
-/// textproto file (including namespace).
+///
+/// With AnalyzeOptions::streaming set, the message and ParseInfoTree are not
+/// built. Instead the textproto is tokenized and fields are resolved against
+/// their descriptors and emitted as they are read.
+///
+/// Every source file of @unit is a textproto and all of them share the pool.
+/// Each is parsed as the message named by a --proto_message_for
+/// <path>=<message> argument of @unit, or else by its --proto_message.
+///
+/// \param unit The compilation unit specifying the textprotos and the
+/// protos that define their schema.
+/// \param file_data The file contents of the textprotos and relevant protos.
+/// \param output The stream to which graph facts are written, in source file
+/// order.
 Status AnalyzeCompilationUnit(const proto::CompilationUnit& unit,
                               const std::vector<proto::FileData>& files,
-                              KytheGraphRecorder* recorder);
+                              KytheOutputStream* output,
+                              const AnalyzeOptions& options = {});
 
 }  // namespace lang_textproto
 }  // namespace kythe
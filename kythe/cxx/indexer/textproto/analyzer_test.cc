@@ -0,0 +1,128 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/indexer/textproto/analyzer.h"
+
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "kythe/cxx/indexer/proto/buffered_output.h"
+
+namespace kythe {
+namespace lang_textproto {
+namespace {
+
+using ::testing::ElementsAreArray;
+using ::testing::IsEmpty;
+using ::testing::Not;
+
+constexpr char kSchemaPath[] = "testdata/schema.proto";
+constexpr char kMappedPath[] = "testdata/mapped.pbtxt";
+constexpr char kFallbackPath[] = "testdata/fallback.pbtxt";
+
+// Each textproto only parses as its own message, so analysis fails unless
+// both are given the right one.
+constexpr char kSchema[] = R"(syntax = "proto3";
+package analyzer_test;
+message Mapped {
+  string name = 1;
+  repeated Mapped children = 2;
+}
+message Fallback {
+  int32 count = 1;
+  repeated string labels = 2;
+}
+)";
+constexpr char kMapped[] = R"(name: "root"
+children { name: "left" }
+children { name: "right" children { name: "leaf" } }
+)";
+constexpr char kFallback[] = R"(count: 3
+labels: "a"
+labels: "b"
+)";
+
+// Returns a unit of two textprotos: one mapped to its message with
+// --proto_message_for, and one falling back to --proto_message.
+proto::CompilationUnit MakeUnit() {
+  proto::CompilationUnit unit;
+  for (const char* path : {kSchemaPath, kMappedPath, kFallbackPath}) {
+    proto::CompilationUnit::FileInput* input = unit.add_required_input();
+    input->mutable_v_name()->set_corpus("corpus");
+    input->mutable_v_name()->set_path(path);
+    input->mutable_info()->set_path(path);
+  }
+  unit.add_source_file(kMappedPath);
+  unit.add_source_file(kFallbackPath);
+  for (const char* arg :
+       {kMappedPath, kFallbackPath, "--proto_message", "analyzer_test.Fallback",
+        "--proto_message_for", "testdata/mapped.pbtxt=analyzer_test.Mapped",
+        "--", "--proto_path", "testdata"}) {
+    unit.add_argument(arg);
+  }
+  return unit;
+}
+
+std::vector<proto::FileData> MakeFiles() {
+  std::vector<proto::FileData> files(3);
+  files[0].mutable_info()->set_path(kSchemaPath);
+  files[0].set_content(kSchema);
+  files[1].mutable_info()->set_path(kMappedPath);
+  files[1].set_content(kMapped);
+  files[2].mutable_info()->set_path(kFallbackPath);
+  files[2].set_content(kFallback);
+  return files;
+}
+
+// Returns `entries` serialized, for comparison.
+std::vector<std::string> Serialize(const std::vector<proto::Entry>& entries) {
+  std::vector<std::string> serialized;
+  for (const proto::Entry& entry : entries) {
+    serialized.push_back(entry.SerializeAsString());
+  }
+  return serialized;
+}
+
+// Analyzes the unit above with `options` and returns its entries, in the
+// order they were written.
+std::vector<std::string> Analyze(const AnalyzeOptions& options) {
+  BufferedOutputStream output;
+  Status status =
+      AnalyzeCompilationUnit(MakeUnit(), MakeFiles(), &output, options);
+  EXPECT_TRUE(status.ok()) << status.ToString();
+  return Serialize(output.TakeEntries());
+}
+
+// Analyzing the textprotos of a unit on more threads than there are
+// textprotos must write exactly what a serial run does, in the same order.
+TEST(AnalyzerTest, ThreadsMatchSerialOutput) {
+  for (bool streaming : {false, true}) {
+    AnalyzeOptions serial;
+    serial.streaming = streaming;
+    AnalyzeOptions parallel = serial;
+    parallel.threads = 4;
+    std::vector<std::string> expected = Analyze(serial);
+    EXPECT_THAT(expected, Not(IsEmpty())) << "streaming: " << streaming;
+    EXPECT_THAT(Analyze(parallel), ElementsAreArray(expected))
+        << "streaming: " << streaming;
+  }
+}
+
+}  // namespace
+}  // namespace lang_textproto
+}  // namespace kythe
@@ -0,0 +1,39 @@
+#!/bin/bash
+# Copyright 2019 The Kythe Authors. All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Runs the textproto indexer on a kzip that it must fail to index, and checks
+# that it reports the failure and exits with status 1 rather than crashing.
+#
+# Usage: indexer_failure_test.sh INDEXER KZIP EXPECTED_ERROR [INDEXER_FLAGS...]
+
+INDEXER=$1; shift
+KZIP=$1; shift
+EXPECTED_ERROR=$1; shift
+
+STDERR="${TEST_TMPDIR}/stderr"
+"${INDEXER}" "$@" --index_file "${KZIP}" -o /dev/null 2> "${STDERR}"
+STATUS=$?
+
+if [ "${STATUS}" -ne 1 ]; then
+  echo "Expected the indexer to exit with status 1, got ${STATUS}"
+  cat "${STDERR}"
+  exit 1
+fi
+if ! grep -q -F "${EXPECTED_ERROR}" "${STDERR}"; then
+  echo "Expected the indexer to report: ${EXPECTED_ERROR}"
+  cat "${STDERR}"
+  exit 1
+fi
+echo "Indexer failed as expected"
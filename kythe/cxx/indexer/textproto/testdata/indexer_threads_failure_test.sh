@@ -0,0 +1,62 @@
+#!/bin/bash
+# Copyright 2019 The Kythe Authors. All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Indexes a kzip holding a unit that must fail among units that must not, with
+# and without the given indexer flags. Both runs must report the failing unit
+# alone and exit with status 1, and write byte-for-byte identical entries.
+# FAILING_SOURCE_FILE is the end of the failing unit's source file path.
+#
+# Usage: indexer_threads_failure_test.sh INDEXER KZIP FAILING_SOURCE_FILE
+#            INDEXER_FLAGS...
+
+INDEXER=$1; shift
+KZIP=$1; shift
+FAILING_SOURCE_FILE=$1; shift
+
+# Runs the indexer with the given flags, writing its entries to $1.entries and
+# its log to $1.stderr, and checks how it failed.
+function index_with_failure() {
+  local -r name="$1"; shift
+  local -r stderr="${TEST_TMPDIR}/${name}.stderr"
+  "${INDEXER}" "$@" --index_file "${KZIP}" -o "${TEST_TMPDIR}/${name}.entries" \
+    2> "${stderr}"
+  local -r status=$?
+  if [ "${status}" -ne 1 ]; then
+    echo "Expected the indexer to exit with status 1 with $*, got ${status}"
+    cat "${stderr}"
+    exit 1
+  fi
+  if ! grep -q "Failed to analyze compilation unit for .*${FAILING_SOURCE_FILE}: " \
+       "${stderr}" ||
+     ! grep -q -F "1 compilation unit(s) failed to analyze" "${stderr}"; then
+    echo "Expected the indexer to report the failure of" \
+      "${FAILING_SOURCE_FILE} alone with $*"
+    cat "${stderr}"
+    exit 1
+  fi
+}
+
+index_with_failure expected
+index_with_failure actual "$@"
+
+if [ ! -s "${TEST_TMPDIR}/expected.entries" ]; then
+  echo "Expected the units that don't fail to be indexed"
+  exit 1
+fi
+if ! cmp "${TEST_TMPDIR}/expected.entries" "${TEST_TMPDIR}/actual.entries"; then
+  echo "Indexer output with $* differs from the default output"
+  exit 1
+fi
+echo "Indexer output with $* matches the default output, failure included"
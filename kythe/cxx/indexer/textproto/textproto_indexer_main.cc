@@ -15,14 +15,22 @@
  */
 
 #include <fcntl.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
 
+#include "absl/memory/memory.h"
+#include "absl/strings/str_join.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
 #include "kythe/cxx/common/indexing/KytheCachingOutput.h"
-#include "kythe/cxx/common/indexing/KytheGraphRecorder.h"
 #include "kythe/cxx/common/kzip_reader.h"
+#include "kythe/cxx/indexer/proto/buffered_output.h"
 #include "kythe/cxx/indexer/textproto/analyzer.h"
 #include "kythe/proto/buildinfo.pb.h"
 #include "kythe/proto/analysis.pb.h"
@@ -31,6 +39,18 @@ DEFINE_string(o, "-", "Output filename.");
 DEFINE_bool(flush_after_each_entry, true,
             "Flush output after writing each entry.");
 DEFINE_string(index_file, "", "Path to a KZip file to index.");
+DEFINE_bool(streaming, false,
+            "Index textprotos from their token stream without building a "
+            "message, keeping memory use bounded for large inputs.");
+DEFINE_string(parse_cache_dir, "",
+              "Directory in which parsed proto files are cached by content. "
+              "May be shared by concurrent indexer processes.");
+DEFINE_int32(threads, 1,
+             "Number of compilation units analyzed concurrently. Output is "
+             "written in kzip order whatever the value.");
+DEFINE_int32(textproto_threads, 1,
+             "Number of threads used to analyze the textprotos of each "
+             "compilation unit.");
 
 namespace kythe {
 namespace lang_textproto {
@@ -63,7 +83,7 @@ void DecodeKzipFile(const std::string& path,
       CHECK(content) << "Unable to read file with digest: "
                      << file.info().digest() << ": " << content.status();
       proto::FileData file_data;
-      file_data.set_content(*content);
+      file_data.set_content(std::move(*content));
       file_data.mutable_info()->set_path(file.info().path());
       file_data.mutable_info()->set_digest(file.info().digest());
       virtual_files.push_back(std::move(file_data));
@@ -78,6 +98,136 @@ void DecodeKzipFile(const std::string& path,
   CHECK(compilation_read) << "Missing compilation in " << path;
 }
 
+// Logs that `unit` could not be analyzed.
+void LogFailure(const proto::CompilationUnit& unit, const Status& status) {
+  LOG(ERROR) << "Failed to analyze compilation unit for "
+             << absl::StrJoin(unit.source_file(), ", ") << ": " << status;
+}
+
+/// \brief Analyzes compilation units on a pool of threads.
+///
+/// Each unit is analyzed into its own buffer and the buffers are written to
+/// the output on the calling thread in the order the units were added, so the
+/// output does not depend on scheduling. Units that fail are logged and their
+/// partial output is written as for a single thread.
+class ParallelUnitAnalyzer {
+ public:
+  ParallelUnitAnalyzer(int threads, const AnalyzeOptions& options,
+                       KytheOutputStream* output)
+      : options_(options),
+        output_(output),
+        max_in_flight_(2 * static_cast<size_t>(std::max(threads, 1))) {
+    for (int i = 0; i < std::max(threads, 1); ++i) {
+      workers_.emplace_back([this] { Work(); });
+    }
+  }
+
+  // disallow copy and assign
+  ParallelUnitAnalyzer(const ParallelUnitAnalyzer&) = delete;
+  void operator=(const ParallelUnitAnalyzer&) = delete;
+
+  ~ParallelUnitAnalyzer() { Finish(); }
+
+  /// \brief Queues `unit` for analysis. Writes the output of finished units
+  /// first, blocking while too many units are unwritten.
+  void Add(const proto::CompilationUnit& unit,
+           std::vector<proto::FileData> files) {
+    WriteUntil(max_in_flight_ - 1);
+    auto job = absl::make_unique<Job>();
+    job->unit = unit;
+    job->files = std::move(files);
+    std::lock_guard<std::mutex> lock(mu_);
+    pending_.push_back(job.get());
+    jobs_.push_back(std::move(job));
+    changed_.notify_all();
+  }
+
+  /// \brief Waits for every queued unit and writes its output.
+  /// \return The number of units that failed so far.
+  size_t Finish() {
+    WriteUntil(0);
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      finishing_ = true;
+      changed_.notify_all();
+    }
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+    workers_.clear();
+    return failures_;
+  }
+
+ private:
+  struct Job {
+    proto::CompilationUnit unit;
+    std::vector<proto::FileData> files;
+    // The fields below are set by a worker under mu_.
+    bool done = false;
+    Status status;
+    std::vector<proto::Entry> entries;
+  };
+
+  // Analyzes pending units until Finish() is called.
+  void Work() {
+    for (;;) {
+      Job* job;
+      {
+        std::unique_lock<std::mutex> lock(mu_);
+        changed_.wait(lock, [this] { return !pending_.empty() || finishing_; });
+        if (pending_.empty()) return;
+        job = pending_.front();
+        pending_.pop_front();
+      }
+      BufferedOutputStream buffer;
+      Status status =
+          AnalyzeCompilationUnit(job->unit, job->files, &buffer, options_);
+      std::lock_guard<std::mutex> lock(mu_);
+      job->status = std::move(status);
+      job->entries = buffer.TakeEntries();
+      job->files.clear();
+      job->done = true;
+      changed_.notify_all();
+    }
+  }
+
+  // Writes finished units in order until at most `in_flight` are unwritten.
+  void WriteUntil(size_t in_flight) {
+    std::unique_lock<std::mutex> lock(mu_);
+    for (;;) {
+      while (!jobs_.empty() && jobs_.front()->done) {
+        std::unique_ptr<Job> job = std::move(jobs_.front());
+        jobs_.pop_front();
+        lock.unlock();
+        EmitEntries(job->entries, output_);
+        if (!job->status.ok()) {
+          LogFailure(job->unit, job->status);
+          ++failures_;
+        }
+        lock.lock();
+      }
+      if (jobs_.size() <= in_flight) return;
+      changed_.wait(lock);
+    }
+  }
+
+  const AnalyzeOptions options_;
+  KytheOutputStream* output_;
+  // The most units that may be queued or buffered at once.
+  const size_t max_in_flight_;
+  // Only touched by the thread that adds units.
+  size_t failures_ = 0;
+
+  std::mutex mu_;
+  std::condition_variable changed_;
+  // Unwritten units, in the order they were added.
+  std::deque<std::unique_ptr<Job>> jobs_;
+  // Units in jobs_ that no worker has started.
+  std::deque<Job*> pending_;
+  bool finishing_ = false;
+  std::vector<std::thread> workers_;
+};
+
 int main(int argc, char* argv[]) {
   google::InitGoogleLogging(argv[0]);
   gflags::SetUsageMessage(
@@ -103,15 +253,37 @@ Example:
   raw_output.SetCloseOnDelete(true);
   FileOutputStream kythe_output(&raw_output);
   kythe_output.set_flush_after_each_entry(FLAGS_flush_after_each_entry);
-  KytheGraphRecorder recorder(&kythe_output);
 
-  DecodeKzipFile(FLAGS_index_file, [&](const proto::CompilationUnit& unit,
-                                       std::vector<proto::FileData> file_data) {
-    Status status =
-        lang_textproto::AnalyzeCompilationUnit(unit, file_data, &recorder);
-    CHECK(status.ok()) << status;
-  });
+  AnalyzeOptions options;
+  options.streaming = FLAGS_streaming;
+  options.parse_cache_dir = FLAGS_parse_cache_dir;
+  options.threads = FLAGS_textproto_threads;
 
+  size_t failures = 0;
+  if (FLAGS_threads > 1) {
+    ParallelUnitAnalyzer analyzer(FLAGS_threads, options, &kythe_output);
+    DecodeKzipFile(FLAGS_index_file,
+                   [&](const proto::CompilationUnit& unit,
+                       std::vector<proto::FileData> file_data) {
+                     analyzer.Add(unit, std::move(file_data));
+                   });
+    failures = analyzer.Finish();
+  } else {
+    DecodeKzipFile(FLAGS_index_file,
+                   [&](const proto::CompilationUnit& unit,
+                       std::vector<proto::FileData> file_data) {
+                     Status status = lang_textproto::AnalyzeCompilationUnit(
+                         unit, file_data, &kythe_output, options);
+                     if (!status.ok()) {
+                       LogFailure(unit, status);
+                       ++failures;
+                     }
+                   });
+  }
+  if (failures > 0) {
+    LOG(ERROR) << failures << " compilation unit(s) failed to analyze";
+    return 1;
+  }
   return 0;
 }
 
@@ -119,4 +291,6 @@ Example:
 }  // namespace lang_textproto
 }  // namespace kythe
 
-int main(int argc, char* argv[]) { kythe::lang_textproto::main(argc, argv); }
+int main(int argc, char* argv[]) {
+  return kythe::lang_textproto::main(argc, argv);
+}